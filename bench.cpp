@@ -0,0 +1,225 @@
+// Microbenchmarks for the scan, combine, lookup, ingest and print paths.
+//
+//     cmake --build build --target bench
+//     ./build/bench --benchmark_filter=Contains
+//
+// Sheets are synthetic and deterministic, from 10^3 to 10^7 rows.  The
+// largest sizes need a few GB of memory; use --benchmark_filter to skip them.
+
+#include "spreadsheet.hpp"
+#include "select.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const char* first_names[] = {"Amanda", "Brian", "Carol", "Joe", "Sarah", "Diane", "David", "Dominick", "George", "Steven"};
+const char* last_names[] = {"Andrews", "Becker", "Conners", "Jackson", "Summers", "Dole", "Genius", "Vargas", "Nguyen", "Okafor"};
+const char* majors[] = {"Computer Science", "Mathematics", "Physics", "History", "Biology", "Chemistry", "Economics"};
+
+template<class T, std::size_t N>
+const char* pick(T (&words)[N], unsigned& seed)
+{
+    seed = seed * 1103515245u + 12345u;
+    return words[(seed >> 16) % N];
+}
+
+void fill(Spreadsheet& sheet, int rows)
+{
+    sheet.set_column_names({"First", "Last", "Age", "Major"});
+    sheet.reserve(rows);
+    unsigned seed = 1;
+    for(int i = 0; i < rows; i++)
+    {
+        const char* first = pick(first_names, seed);
+        const char* last = pick(last_names, seed);
+        std::string age = std::to_string(18 + (seed >> 8) % 50);
+        sheet.emplace_row(first, last, age, pick(majors, seed));
+    }
+}
+
+// The sheet for the current benchmark.  Only one is kept so that the large
+// sizes do not pile up in memory.
+Spreadsheet& sheet_of(int rows, Spreadsheet::Storage storage)
+{
+    static std::unique_ptr<Spreadsheet> sheet;
+    static int sheet_rows = -1;
+    static Spreadsheet::Storage sheet_storage;
+    if(!sheet || sheet_rows != rows || sheet_storage != storage)
+    {
+        sheet.reset();
+        sheet.reset(new Spreadsheet);
+        sheet->set_storage(storage);
+        fill(*sheet, rows);
+        sheet_rows = rows;
+        sheet_storage = storage;
+    }
+    return *sheet;
+}
+
+void sizes_and_storage(benchmark::internal::Benchmark* b)
+{
+    for(int storage = Spreadsheet::ROW_MAJOR; storage <= Spreadsheet::COLUMN_MAJOR; storage++)
+        for(int rows = 1000; rows <= 10000000; rows *= 10)
+            b->Args({rows, storage});
+}
+
+Spreadsheet& sheet_for(const benchmark::State& state)
+{
+    return sheet_of(state.range(0), Spreadsheet::Storage(state.range(1)));
+}
+
+void BM_SelectContains(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_for(state);
+    for(auto _ : state)
+    {
+        Select* select = new Select_Contains(&sheet, "Last", "Dole");
+        benchmark::DoNotOptimize(select);
+        delete select;
+    }
+    state.SetItemsProcessed(state.iterations() * sheet.get_row_size());
+}
+BENCHMARK(BM_SelectContains)->Apply(sizes_and_storage)->Unit(benchmark::kMicrosecond);
+
+void BM_SelectAnd(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_for(state);
+    for(auto _ : state)
+    {
+        Select* select = new Select_And(
+            new Select_Contains(&sheet, "Last", "Dole"),
+            new Select_Contains(&sheet, "Major", "Science"));
+        benchmark::DoNotOptimize(select);
+        delete select;
+    }
+    state.SetItemsProcessed(state.iterations() * sheet.get_row_size());
+}
+BENCHMARK(BM_SelectAnd)->Apply(sizes_and_storage)->Unit(benchmark::kMicrosecond);
+
+void BM_SelectOr(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_for(state);
+    for(auto _ : state)
+    {
+        Select* select = new Select_Or(
+            new Select_Contains(&sheet, "First", "Amanda"),
+            new Select_Or(
+                new Select_Contains(&sheet, "Last", "on"),
+                new Select_Contains(&sheet, "Age", "9")));
+        benchmark::DoNotOptimize(select);
+        delete select;
+    }
+    state.SetItemsProcessed(state.iterations() * sheet.get_row_size());
+}
+BENCHMARK(BM_SelectOr)->Apply(sizes_and_storage)->Unit(benchmark::kMicrosecond);
+
+void BM_SelectNot(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_for(state);
+    for(auto _ : state)
+    {
+        Select* select = new Select_Not(new Select_Contains(&sheet, "First", "v"));
+        benchmark::DoNotOptimize(select);
+        delete select;
+    }
+    state.SetItemsProcessed(state.iterations() * sheet.get_row_size());
+}
+BENCHMARK(BM_SelectNot)->Apply(sizes_and_storage)->Unit(benchmark::kMicrosecond);
+
+// Point lookups of a row against an installed selection, which is how
+// callers outside print_selection consume it.
+void BM_SelectRowLookup(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_for(state);
+    Select_And select(
+        new Select_Contains(&sheet, "Last", "Dole"),
+        new Select_Not(new Select_Contains(&sheet, "First", "v")));
+    int rows = sheet.get_row_size();
+    for(auto _ : state)
+    {
+        int hits = 0;
+        for(int i = 0; i < rows; i++)
+            hits += select.select(i);
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_SelectRowLookup)->Apply(sizes_and_storage)->Unit(benchmark::kMicrosecond);
+
+void BM_GetColumnByName(benchmark::State& state)
+{
+    int columns = state.range(0);
+    std::vector<std::string> names;
+    for(int j = 0; j < columns; j++)
+        names.push_back("column_" + std::to_string(j));
+    Spreadsheet sheet;
+    sheet.set_column_names(names);
+
+    int j = 0;
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(sheet.get_column_by_name(names[j]));
+        if(++j == columns)
+            j = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetColumnByName)->RangeMultiplier(10)->Range(10, 100000);
+
+void BM_AddRow(benchmark::State& state)
+{
+    int rows = state.range(0);
+    Spreadsheet::Storage storage = Spreadsheet::Storage(state.range(1));
+    for(auto _ : state)
+    {
+        Spreadsheet sheet;
+        sheet.set_storage(storage);
+        fill(sheet, rows);
+        benchmark::DoNotOptimize(sheet.get_row_size());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_AddRow)->Apply(sizes_and_storage)->Unit(benchmark::kMillisecond);
+
+// Output throughput to /dev/null, with every row selected and with a
+// selective query, on one thread and on four.
+void BM_PrintSelection(benchmark::State& state)
+{
+    Spreadsheet& sheet = sheet_of(state.range(0), Spreadsheet::ROW_MAJOR);
+    sheet.set_thread_count(state.range(2));
+    if(state.range(1))
+        sheet.set_selection(new Select_Contains(&sheet, "Last", "Dole"));
+    else
+        sheet.set_selection(nullptr);
+
+    std::stringstream sized;
+    sheet.print_selection(sized);
+    std::size_t bytes = sized.str().size();
+
+    int fd = open("/dev/null", O_WRONLY);
+    for(auto _ : state)
+        sheet.print_selection(fd);
+    close(fd);
+    sheet.set_selection(nullptr);
+    sheet.set_thread_count(1);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.SetItemsProcessed(state.iterations() * sheet.get_row_size());
+}
+BENCHMARK(BM_PrintSelection)
+    ->ArgsProduct({{1000, 100000, 10000000}, {0, 1}, {1, 4}})
+    ->ArgNames({"rows", "selective", "threads"})
+    ->Unit(benchmark::kMillisecond);
+
+}
+
+BENCHMARK_MAIN();
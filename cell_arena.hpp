@@ -0,0 +1,81 @@
+#ifndef __CELL_ARENA_HPP__
+#define __CELL_ARENA_HPP__
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Bump allocator for cell bytes.  Cells are copied into large chunks one
+// after another and are never freed individually; reset() forgets every cell
+// at once and keeps the chunks for reuse, so emptying a sheet costs nothing
+// per cell.  Stored bytes never move, so pointers into the arena stay valid
+// until reset().
+class Cell_Arena
+{
+    std::vector<std::unique_ptr<char[]> > chunks;
+    std::vector<std::size_t> sizes;
+    int current = -1;
+    char* next = nullptr;
+    std::size_t left = 0;
+
+    static const std::size_t first_chunk = 4096;
+    static const std::size_t max_chunk = 1 << 20;
+
+    // Move to the next retained chunk that can hold length bytes, or
+    // allocate one.
+    void grow(std::size_t length)
+    {
+        while(++current < chunks.size())
+        {
+            if(sizes[current] >= length)
+            {
+                next = chunks[current].get();
+                left = sizes[current];
+                return;
+            }
+        }
+        std::size_t size = first_chunk;
+        if(!sizes.empty())
+            size = sizes.back() * 2 < max_chunk ? sizes.back() * 2 : std::size_t(max_chunk);
+        if(size < length)
+            size = length;
+        chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+        sizes.push_back(size);
+        current = chunks.size() - 1;
+        next = chunks.back().get();
+        left = size;
+    }
+
+public:
+    // Copy length bytes into the arena and return where they now live.
+    const char* store(const char* data, std::size_t length)
+    {
+        if(length == 0)
+            return "";
+        if(length > left)
+            grow(length);
+        char* out = next;
+        std::memcpy(out, data, length);
+        next += length;
+        left -= length;
+        return out;
+    }
+
+    void reset()
+    {
+        current = -1;
+        next = nullptr;
+        left = 0;
+    }
+
+    std::size_t capacity() const
+    {
+        std::size_t total = 0;
+        for(int i = 0; i < sizes.size(); i++)
+            total += sizes[i];
+        return total;
+    }
+};
+
+#endif //__CELL_ARENA_HPP__
@@ -0,0 +1,67 @@
+#ifndef __CELL_VIEW_HPP__
+#define __CELL_VIEW_HPP__
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+
+// A read-only window onto the bytes of one cell.  Depending on the storage
+// backend a cell lives either in its own std::string or inside a column's
+// shared arena, so readers see both through the same pointer/length pair.
+// The view is only valid until the spreadsheet is next modified.
+class Cell_View
+{
+    const char* ptr;
+    std::size_t len;
+
+public:
+    static const std::size_t npos = std::string::npos;
+
+    Cell_View(): ptr(""), len(0) {}
+    Cell_View(const char* data, std::size_t size): ptr(data), len(size) {}
+    Cell_View(const std::string& s): ptr(s.data()), len(s.size()) {}
+
+    const char* data() const { return ptr; }
+    std::size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    char operator[](std::size_t i) const { return ptr[i]; }
+    const char* begin() const { return ptr; }
+    const char* end() const { return ptr + len; }
+
+    // Same contract as std::string::find.
+    std::size_t find(const char* needle, std::size_t n, std::size_t pos = 0) const
+    {
+        if(pos > len || n > len - pos)
+            return npos;
+        const char* hit = std::search(ptr + pos, ptr + len, needle, needle + n);
+        return hit == ptr + len && n != 0 ? npos : hit - ptr;
+    }
+
+    std::size_t find(const std::string& needle, std::size_t pos = 0) const
+    {
+        return find(needle.data(), needle.size(), pos);
+    }
+
+    std::string str() const { return std::string(ptr, len); }
+    operator std::string() const { return str(); }
+};
+
+inline bool operator==(const Cell_View& a, const Cell_View& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+inline bool operator==(const Cell_View& a, const std::string& b) { return a == Cell_View(b); }
+inline bool operator==(const std::string& a, const Cell_View& b) { return Cell_View(a) == b; }
+inline bool operator==(const Cell_View& a, const char* b) { return a == Cell_View(b, std::strlen(b)); }
+inline bool operator==(const char* a, const Cell_View& b) { return b == a; }
+inline bool operator!=(const Cell_View& a, const Cell_View& b) { return !(a == b); }
+inline bool operator!=(const Cell_View& a, const std::string& b) { return !(a == b); }
+inline bool operator!=(const Cell_View& a, const char* b) { return !(a == b); }
+
+inline std::ostream& operator<<(std::ostream& out, const Cell_View& cell)
+{
+    return out.write(cell.data(), cell.size());
+}
+
+#endif //__CELL_VIEW_HPP__
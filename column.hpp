@@ -0,0 +1,144 @@
+#ifndef __COLUMN_HPP__
+#define __COLUMN_HPP__
+
+#include "cell_view.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdexcept>
+
+// Column-major storage for one column of a Spreadsheet.  All cell bytes are
+// appended to a single contiguous arena and each row records where its bytes
+// start and how long they are, so a scan down the column reads memory in
+// order instead of hopping between per-row heap blocks.
+//
+// A column can instead be dictionary encoded: the arena then holds each
+// distinct value once and every row stores a small integer code into that
+// table.  Predicates can test each distinct value once and then select rows
+// by code.
+class Column
+{
+    struct Span
+    {
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    std::string arena;
+    // One span per row, or one per distinct value when encoded.
+    std::vector<Span> cells;
+    std::vector<uint32_t> codes;
+    std::unordered_map<std::string, uint32_t> lookup;
+    bool dictionary = false;
+
+    Span store(const char* data, std::size_t length)
+    {
+        Span s = {arena.size(), length};
+        arena.append(data, length);
+        return s;
+    }
+
+    uint32_t intern(const char* data, std::size_t length)
+    {
+        auto it = lookup.insert(std::make_pair(std::string(data, length), uint32_t(cells.size())));
+        if(it.second)
+            cells.push_back(store(data, length));
+        return it.first->second;
+    }
+
+    Cell_View view(const Span& s) const
+    {
+        return Cell_View(arena.data() + s.offset, s.length);
+    }
+
+public:
+    int size() const { return dictionary ? codes.size() : cells.size(); }
+
+    Cell_View at(int row) const
+    {
+        if(dictionary)
+            return view(cells[codes.at(row)]);
+        return view(cells.at(row));
+    }
+
+    void append(const char* data, std::size_t length)
+    {
+        if(dictionary)
+            codes.push_back(intern(data, length));
+        else
+            cells.push_back(store(data, length));
+    }
+
+    void append(const std::string& value) { append(value.data(), value.size()); }
+
+    // Overwrite a cell.  A value that fits is written in place; a longer one
+    // is appended to the arena and the old bytes are left unused.  In an
+    // encoded column the row just takes the new value's code.
+    void assign(int row, const char* data, std::size_t length)
+    {
+        if(dictionary)
+        {
+            uint32_t code = intern(data, length);
+            codes.at(row) = code;
+            return;
+        }
+        Span& s = cells.at(row);
+        if(length > s.length)
+        {
+            s.offset = arena.size();
+            arena.append(data, length);
+        }
+        else
+            arena.replace(s.offset, length, data, length);
+        s.length = length;
+    }
+
+    void reserve(int rows, std::size_t bytes)
+    {
+        if(dictionary)
+        {
+            codes.reserve(rows);
+            return;
+        }
+        cells.reserve(rows);
+        arena.reserve(bytes);
+    }
+
+    void clear()
+    {
+        arena.clear();
+        cells.clear();
+        codes.clear();
+        lookup.clear();
+    }
+
+    bool encoded() const { return dictionary; }
+
+    // Switch between plain and dictionary-encoded layouts, rewriting the
+    // stored rows.
+    void set_encoded(bool encode)
+    {
+        if(encode == dictionary)
+            return;
+        Column converted;
+        converted.dictionary = encode;
+        converted.reserve(size(), 0);
+        for(int i = 0; i < size(); i++)
+        {
+            Cell_View cell = at(i);
+            converted.append(cell.data(), cell.size());
+        }
+        if(!encode)
+            converted.arena.shrink_to_fit();
+        *this = std::move(converted);
+    }
+
+    // Encoded columns only: the distinct values and each row's code.
+    int distinct() const { return cells.size(); }
+    Cell_View value(uint32_t code) const { return view(cells.at(code)); }
+    const uint32_t* code_data() const { return codes.data(); }
+};
+
+#endif //__COLUMN_HPP__
@@ -0,0 +1,117 @@
+#include "hash_join.hpp"
+
+#include <stdexcept>
+
+Hash_Join::Hash_Join(const Spreadsheet& left, const std::vector<std::string>& left_columns,
+                     const Spreadsheet& right, const std::vector<std::string>& right_columns)
+    : left(&left), right(&right),
+      left_keys(left.require_columns(left_columns)), right_keys(right.require_columns(right_columns)),
+      build_left(left.selected_rows().size() <= right.selected_rows().size())
+{
+    if(left_keys.size() != right_keys.size())
+        throw std::invalid_argument("Hash_Join: key column lists differ in length");
+
+    const Spreadsheet* build = build_left ? this->left : this->right;
+    const std::vector<int>& keys = build_left ? left_keys : right_keys;
+    std::vector<int> rows;
+    for(Row_View row : build->selected_rows())
+        rows.push_back(row.index());
+
+    // Insert back to front so each chain lists its rows in order.
+    next.assign(build->get_row_size(), -1);
+    heads.reserve(rows.size());
+    std::string key;
+    for(int k = rows.size() - 1; k >= 0; k--)
+    {
+        build->row_key(rows[k], keys, key);
+        std::pair<std::unordered_map<std::string, int>::iterator, bool> slot =
+            heads.insert(std::make_pair(key, rows[k]));
+        if(!slot.second)
+        {
+            next[rows[k]] = slot.first->second;
+            slot.first->second = rows[k];
+        }
+    }
+}
+
+int Hash_Join::first_match(int probe_row, std::string& key) const
+{
+    probe_sheet()->row_key(probe_row, build_left ? right_keys : left_keys, key);
+    std::unordered_map<std::string, int>::const_iterator it = heads.find(key);
+    return it == heads.end() ? -1 : it->second;
+}
+
+int Hash_Join::next_match(int build_row) const
+{
+    return next[build_row];
+}
+
+Join_Iterator Hash_Join::begin() const
+{
+    Selection_Range probe = probe_sheet()->selected_rows();
+    return Join_Iterator(this, probe.begin(), probe.end());
+}
+
+Join_Iterator Hash_Join::end() const
+{
+    Selection_Range probe = probe_sheet()->selected_rows();
+    return Join_Iterator(this, probe.end(), probe.end());
+}
+
+void Hash_Join::materialize(Spreadsheet& out) const
+{
+    if(&out == left || &out == right)
+        throw std::invalid_argument("Hash_Join: cannot materialize into one of the joined sheets");
+    const std::vector<std::string>& left_names = left->get_column_names();
+    const std::vector<std::string>& right_names = right->get_column_names();
+    std::vector<std::string> names(left_names);
+    names.insert(names.end(), right_names.begin(), right_names.end());
+    out.clear();
+    out.set_column_names(names);
+
+    std::vector<Cell_View> cells(names.size());
+    for(Join_Iterator it = begin(); it != end(); ++it)
+    {
+        std::pair<int, int> rows = *it;
+        for(int j = 0; j < left_names.size(); j++)
+            cells[j] = left->cell_data(rows.first, j);
+        for(int j = 0; j < right_names.size(); j++)
+            cells[left_names.size() + j] = right->cell_data(rows.second, j);
+        out.add_row(cells.data(), cells.size());
+    }
+}
+
+Join_Iterator::Join_Iterator(const Hash_Join* join, Selection_Iterator probe, Selection_Iterator probe_end)
+    : join(join), probe(probe), probe_end(probe_end), match(-1)
+{
+    if(this->probe != this->probe_end)
+    {
+        match = join->first_match((*this->probe).index(), key);
+        settle();
+    }
+}
+
+// Move on to the next probe row with a match, unless the current one still
+// has one.
+void Join_Iterator::settle()
+{
+    while(match == -1 && probe != probe_end)
+    {
+        ++probe;
+        if(probe != probe_end)
+            match = join->first_match((*probe).index(), key);
+    }
+}
+
+std::pair<int, int> Join_Iterator::operator*() const
+{
+    int probe_row = (*probe).index();
+    return join->build_left ? std::make_pair(match, probe_row) : std::make_pair(probe_row, match);
+}
+
+Join_Iterator& Join_Iterator::operator++()
+{
+    match = join->next_match(match);
+    settle();
+    return *this;
+}
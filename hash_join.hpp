@@ -0,0 +1,98 @@
+#ifndef __HASH_JOIN_HPP__
+#define __HASH_JOIN_HPP__
+
+#include "spreadsheet.hpp"
+#include "selection_range.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Hash_Join;
+
+// Walks the matching (left row, right row) pairs of a Hash_Join, probing
+// one row at a time; pairs are not stored.
+class Join_Iterator
+{
+    const Hash_Join* join;
+    Selection_Iterator probe;
+    Selection_Iterator probe_end;
+    int match;
+    std::string key;
+
+    void settle();
+
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef std::pair<int, int> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const std::pair<int, int>* pointer;
+    typedef std::pair<int, int> reference;
+
+    Join_Iterator(const Hash_Join* join, Selection_Iterator probe, Selection_Iterator probe_end);
+
+    std::pair<int, int> operator*() const;
+
+    Join_Iterator& operator++();
+
+    Join_Iterator operator++(int)
+    {
+        Join_Iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    bool operator==(const Join_Iterator& other) const { return probe == other.probe && match == other.match; }
+    bool operator!=(const Join_Iterator& other) const { return !(*this == other); }
+};
+
+// Equi-join of two sheets on named key columns, compared as cell bytes:
+//
+//     Hash_Join join(students, {"Major"}, majors, {"Name"});
+//     for(std::pair<int, int> rows : join) ...
+//     join.materialize(report);
+//
+// Only the rows chosen by each sheet's installed selection take part.  The
+// side with fewer selected rows is loaded into a hash table when the join
+// is constructed; iterating probes it with the other side's rows.  Pairs
+// come out in probe-row order, and within a probe row in build-row order.
+// Both sheets must stay unchanged while the join is used.
+class Hash_Join
+{
+    const Spreadsheet* left;
+    const Spreadsheet* right;
+    std::vector<int> left_keys, right_keys;
+    bool build_left;
+
+    // Build-side rows by key: the first row of each key, and indexed by
+    // build row the next row with the same key (or -1).
+    std::unordered_map<std::string, int> heads;
+    std::vector<int> next;
+
+    friend class Join_Iterator;
+
+    const Spreadsheet* probe_sheet() const { return build_left ? right : left; }
+
+    // First build row matching a probe row, or -1; key is scratch space.
+    int first_match(int probe_row, std::string& key) const;
+    int next_match(int build_row) const;
+
+public:
+    // Throws std::out_of_range for an unknown column and
+    // std::invalid_argument if the key lists differ in length.
+    Hash_Join(const Spreadsheet& left, const std::vector<std::string>& left_columns,
+              const Spreadsheet& right, const std::vector<std::string>& right_columns);
+
+    Join_Iterator begin() const;
+    Join_Iterator end() const;
+
+    // Replace the contents of out with one row per pair: the left row's
+    // cells followed by the right row's, under both sheets' column names.
+    // Throws std::invalid_argument if out is one of the joined sheets.
+    void materialize(Spreadsheet& out) const;
+};
+
+#endif //__HASH_JOIN_HPP__
@@ -0,0 +1,62 @@
+#include "ngram_index.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+std::vector<uint32_t> Ngram_Index::trigrams(Cell_View text)
+{
+    std::vector<uint32_t> keys;
+    if(text.size() < n)
+        return keys;
+    keys.reserve(text.size() - n + 1);
+    for(std::size_t i = 0; i + n <= text.size(); i++)
+        keys.push_back(key(text.data() + i));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+void Ngram_Index::add(int row, Cell_View cell)
+{
+    std::vector<uint32_t> keys = trigrams(cell);
+    for(int k = 0; k < keys.size(); k++)
+    {
+        std::vector<int>& rows = postings[keys[k]];
+        if(rows.empty() || rows.back() < row)
+            rows.push_back(row);
+        else
+        {
+            std::vector<int>::iterator it = std::lower_bound(rows.begin(), rows.end(), row);
+            if(*it != row)
+                rows.insert(it, row);
+        }
+    }
+}
+
+std::vector<int> Ngram_Index::candidates(const std::string& needle) const
+{
+    std::vector<uint32_t> keys = trigrams(needle);
+    std::vector<const std::vector<int>*> lists;
+    for(int k = 0; k < keys.size(); k++)
+    {
+        std::unordered_map<uint32_t, std::vector<int> >::const_iterator it = postings.find(keys[k]);
+        if(it == postings.end())
+            return std::vector<int>();
+        lists.push_back(&it->second);
+    }
+
+    // Intersect starting from the shortest list so the working set only
+    // shrinks.
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<int>* a, const std::vector<int>* b) { return a->size() < b->size(); });
+    std::vector<int> result = *lists[0];
+    std::vector<int> next;
+    for(int k = 1; k < lists.size() && !result.empty(); k++)
+    {
+        next.clear();
+        std::set_intersection(result.begin(), result.end(), lists[k]->begin(), lists[k]->end(),
+                              std::back_inserter(next));
+        result.swap(next);
+    }
+    return result;
+}
@@ -0,0 +1,46 @@
+#ifndef __NGRAM_INDEX_HPP__
+#define __NGRAM_INDEX_HPP__
+
+#include "cell_view.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Inverted trigram index over one column.  Every run of three bytes in a
+// cell maps to the sorted list of rows containing it.  A row can only
+// contain a needle of three or more bytes if it contains all of the
+// needle's trigrams, so intersecting their lists gives a short candidate
+// list that still has to be checked with an exact search.
+class Ngram_Index
+{
+    std::unordered_map<uint32_t, std::vector<int> > postings;
+
+    static uint32_t key(const char* p)
+    {
+        return uint32_t((unsigned char)p[0]) << 16 |
+               uint32_t((unsigned char)p[1]) << 8 |
+               uint32_t((unsigned char)p[2]);
+    }
+
+    // The distinct trigrams of a string, sorted.
+    static std::vector<uint32_t> trigrams(Cell_View text);
+
+public:
+    static const int n = 3;
+
+    // Record the trigrams of a row.  Rows normally arrive in increasing
+    // order; a row added again after its cell was overwritten is merged into
+    // place.  Stale entries for the old value only cost an extra candidate.
+    void add(int row, Cell_View cell);
+
+    // Whether the index can narrow a search for this needle.
+    static bool usable(const std::string& needle) { return needle.size() >= n; }
+
+    // Rows that may contain the needle, in increasing order.  Only valid if
+    // usable(needle).
+    std::vector<int> candidates(const std::string& needle) const;
+};
+
+#endif //__NGRAM_INDEX_HPP__
@@ -0,0 +1,60 @@
+#include "output_writer.hpp"
+
+#include <cerrno>
+#include <ostream>
+#include <system_error>
+#include <unistd.h>
+
+Output_Writer::Output_Writer(std::ostream& out, std::size_t limit)
+    : stream(&out), fd(-1), limit(limit)
+{
+}
+
+Output_Writer::Output_Writer(int fd, std::size_t limit)
+    : stream(nullptr), fd(fd), limit(limit)
+{
+}
+
+void Output_Writer::write_out(const char* data, std::size_t length)
+{
+    if(stream)
+    {
+        stream->write(data, length);
+        return;
+    }
+    while(length > 0)
+    {
+        ssize_t written = ::write(fd, data, length);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "Output_Writer: write failed");
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+void Output_Writer::write(const char* data, std::size_t length)
+{
+    if(buffer.size() + length <= limit)
+    {
+        buffer.append(data, length);
+        return;
+    }
+    write_out(buffer.data(), buffer.size());
+    buffer.clear();
+    if(length >= limit)
+        write_out(data, length);
+    else
+        buffer.append(data, length);
+}
+
+void Output_Writer::flush()
+{
+    write_out(buffer.data(), buffer.size());
+    buffer.clear();
+    if(stream)
+        stream->flush();
+}
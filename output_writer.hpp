@@ -0,0 +1,44 @@
+#ifndef __OUTPUT_WRITER_HPP__
+#define __OUTPUT_WRITER_HPP__
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+// Collects formatted output in one large buffer and hands it to the sink
+// (a std::ostream or a raw file descriptor) in big writes, instead of one
+// small write and a flush per row.
+class Output_Writer
+{
+    std::ostream* stream;
+    int fd;
+    std::string buffer;
+    std::size_t limit;
+
+    void write_out(const char* data, std::size_t length);
+
+public:
+    static const std::size_t default_limit = 1 << 20;
+
+    explicit Output_Writer(std::ostream& out, std::size_t limit = default_limit);
+    explicit Output_Writer(int fd, std::size_t limit = default_limit);
+
+    // Formatters append here directly, then call maybe_flush().
+    std::string& data() { return buffer; }
+
+    void maybe_flush()
+    {
+        if(buffer.size() >= limit)
+            flush();
+    }
+
+    // Append a block of already formatted output.  Blocks at least as big as
+    // the buffer go straight to the sink.
+    void write(const char* data, std::size_t length);
+
+    // Write out everything buffered and flush the stream.  Throws
+    // std::system_error if writing to a file descriptor fails.
+    void flush();
+};
+
+#endif //__OUTPUT_WRITER_HPP__
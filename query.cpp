@@ -0,0 +1,411 @@
+#include "query.hpp"
+#include "select.hpp"
+#include "substring_search.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+struct Query::Node
+{
+    enum Kind { CONTAINS, CONSTANT, NOT, AND, OR };
+
+    Kind kind;
+    std::string name;         // CONTAINS: column as written
+    Column_Handle column;     // CONTAINS
+    std::string needle;       // CONTAINS
+    bool value = false;       // CONSTANT
+    std::vector<std::unique_ptr<Node> > children;
+    double selectivity = 0.0;
+
+    explicit Node(Kind kind) : kind(kind) {}
+};
+
+namespace
+{
+
+typedef Query::Node Node;
+typedef std::unique_ptr<Node> Node_Ptr;
+
+const int sample_rows = 256;
+
+std::string quote(const std::string& text)
+{
+    std::string out = "\"";
+    for(int i = 0; i < text.size(); i++)
+    {
+        if(text[i] == '"' || text[i] == '\\')
+            out += '\\';
+        out += text[i];
+    }
+    return out + "\"";
+}
+
+bool is_word(const std::string& text)
+{
+    if(text.empty() || !(std::isalpha((unsigned char)text[0]) || text[0] == '_'))
+        return false;
+    for(int i = 1; i < text.size(); i++)
+        if(!(std::isalnum((unsigned char)text[i]) || text[i] == '_'))
+            return false;
+    return true;
+}
+
+Node_Ptr constant(bool value)
+{
+    Node_Ptr node(new Node(Node::CONSTANT));
+    node->value = value;
+    node->selectivity = value ? 1.0 : 0.0;
+    return node;
+}
+
+// Recursive-descent parser; each rule returns an unplanned tree.
+//
+//     or      := and { OR and }
+//     and     := unary { AND unary }
+//     unary   := NOT unary | '(' or ')' | TRUE | FALSE | column '~' string
+//     column  := word | string
+class Parser
+{
+    enum Token { END, WORD, STRING, TILDE, LPAREN, RPAREN };
+
+    const std::string& text;
+    std::size_t pos = 0;
+    Token token = END;
+    std::size_t token_start = 0;
+    std::string token_text;
+
+    void fail(const std::string& message) const
+    {
+        throw Query_Error(message + " at offset " + std::to_string(token_start), token_start);
+    }
+
+    void next()
+    {
+        while(pos < text.size() && std::isspace((unsigned char)text[pos]))
+            pos++;
+        token_start = pos;
+        token_text.clear();
+        if(pos == text.size())
+        {
+            token = END;
+            return;
+        }
+
+        char c = text[pos];
+        if(c == '~' || c == '(' || c == ')')
+        {
+            token = c == '~' ? TILDE : c == '(' ? LPAREN : RPAREN;
+            pos++;
+        }
+        else if(c == '"')
+        {
+            token = STRING;
+            for(pos++; ; pos++)
+            {
+                if(pos == text.size())
+                    fail("unterminated string");
+                if(text[pos] == '"')
+                    break;
+                if(text[pos] == '\\' && pos + 1 < text.size())
+                    pos++;
+                token_text += text[pos];
+            }
+            pos++;
+        }
+        else if(std::isalpha((unsigned char)c) || c == '_')
+        {
+            token = WORD;
+            while(pos < text.size() && (std::isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+                token_text += text[pos++];
+        }
+        else
+            fail(std::string("unexpected character '") + c + "'");
+    }
+
+    bool keyword(const char* word) const
+    {
+        if(token != WORD || token_text.size() != std::char_traits<char>::length(word))
+            return false;
+        for(int i = 0; i < token_text.size(); i++)
+            if(std::toupper((unsigned char)token_text[i]) != word[i])
+                return false;
+        return true;
+    }
+
+    Node_Ptr parse_or()
+    {
+        Node_Ptr left = parse_and();
+        if(!keyword("OR"))
+            return left;
+        Node_Ptr node(new Node(Node::OR));
+        node->children.push_back(std::move(left));
+        while(keyword("OR"))
+        {
+            next();
+            node->children.push_back(parse_and());
+        }
+        return node;
+    }
+
+    Node_Ptr parse_and()
+    {
+        Node_Ptr left = parse_unary();
+        if(!keyword("AND"))
+            return left;
+        Node_Ptr node(new Node(Node::AND));
+        node->children.push_back(std::move(left));
+        while(keyword("AND"))
+        {
+            next();
+            node->children.push_back(parse_unary());
+        }
+        return node;
+    }
+
+    Node_Ptr parse_unary()
+    {
+        if(keyword("NOT"))
+        {
+            next();
+            Node_Ptr node(new Node(Node::NOT));
+            node->children.push_back(parse_unary());
+            return node;
+        }
+        if(token == LPAREN)
+        {
+            next();
+            Node_Ptr node = parse_or();
+            if(token != RPAREN)
+                fail("expected ')'");
+            next();
+            return node;
+        }
+        if(keyword("TRUE") || keyword("FALSE"))
+        {
+            bool value = keyword("TRUE");
+            next();
+            return constant(value);
+        }
+        if(token != WORD && token != STRING)
+            fail("expected a column name");
+        if(token == WORD && (keyword("AND") || keyword("OR")))
+            fail("expected a column name");
+
+        Node_Ptr node(new Node(Node::CONTAINS));
+        node->name = token_text;
+        next();
+        if(token != TILDE)
+            fail("expected '~'");
+        next();
+        if(token != STRING)
+            fail("expected a quoted string");
+        node->needle = token_text;
+        next();
+        return node;
+    }
+
+public:
+    explicit Parser(const std::string& text) : text(text) { next(); }
+
+    Node_Ptr parse()
+    {
+        Node_Ptr root = parse_or();
+        if(token != END)
+            fail("unexpected '" + text.substr(token_start, pos - token_start) + "'");
+        return root;
+    }
+};
+
+// Fraction of sampled rows whose cell contains the needle.
+double sample(const Spreadsheet* sheet, int column, const std::string& needle)
+{
+    int rows = sheet->get_row_size();
+    int samples = std::min(rows, sample_rows);
+    if(samples == 0)
+        return 0.0;
+    Substring_Matcher matcher(needle);
+    int hits = 0;
+    for(int k = 0; k < samples; k++)
+    {
+        Cell_View cell = sheet->cell_data(int((long long)k * rows / samples), column);
+        if(matcher.contains(cell.data(), cell.size()))
+            hits++;
+    }
+    return double(hits) / samples;
+}
+
+// Stable text of a planned subtree, used to spot duplicate children.
+std::string key(const Node& node)
+{
+    switch(node.kind)
+    {
+    case Node::CONTAINS:
+        return "C" + std::to_string(node.column.index()) + ":" + quote(node.needle);
+    case Node::CONSTANT:
+        return node.value ? "T" : "F";
+    case Node::NOT:
+        return "N(" + key(*node.children[0]) + ")";
+    default:
+        {
+            std::string out = node.kind == Node::AND ? "A(" : "O(";
+            for(int i = 0; i < node.children.size(); i++)
+                out += (i ? "," : "") + key(*node.children[i]);
+            return out + ")";
+        }
+    }
+}
+
+// Rewrite node into its planned form and fill in selectivity.
+Node_Ptr plan(const Spreadsheet* sheet, Node_Ptr node)
+{
+    switch(node->kind)
+    {
+    case Node::CONSTANT:
+        return node;
+
+    case Node::CONTAINS:
+        {
+            node->column = sheet->resolve_column(node->name);
+            if(!node->column.valid())
+                return constant(false);
+            if(node->needle.empty())
+                return constant(true);
+            node->selectivity = sample(sheet, node->column.index(), node->needle);
+            return node;
+        }
+
+    case Node::NOT:
+        {
+            Node_Ptr child = plan(sheet, std::move(node->children[0]));
+            if(child->kind == Node::CONSTANT)
+                return constant(!child->value);
+            if(child->kind == Node::NOT)
+                return std::move(child->children[0]);
+            node->children[0] = std::move(child);
+            node->selectivity = 1.0 - node->children[0]->selectivity;
+            return node;
+        }
+
+    default:
+        {
+            // AND and OR: the absorbing constant decides the whole node and
+            // the identity constant contributes nothing.
+            bool is_and = node->kind == Node::AND;
+            std::vector<Node_Ptr> kept;
+            std::vector<std::string> seen;
+            std::vector<Node_Ptr> pending;
+            pending.swap(node->children);
+            for(int i = 0; i < pending.size(); i++)
+            {
+                Node_Ptr child = plan(sheet, std::move(pending[i]));
+                if(child->kind == Node::CONSTANT)
+                {
+                    if(child->value != is_and)
+                        return constant(!is_and);
+                    continue;
+                }
+                std::vector<Node_Ptr> parts;
+                if(child->kind == node->kind)
+                    parts.swap(child->children);
+                else
+                    parts.push_back(std::move(child));
+                for(int j = 0; j < parts.size(); j++)
+                {
+                    std::string k = key(*parts[j]);
+                    if(std::find(seen.begin(), seen.end(), k) != seen.end())
+                        continue;
+                    seen.push_back(k);
+                    kept.push_back(std::move(parts[j]));
+                }
+            }
+            if(kept.empty())
+                return constant(is_and);
+            if(kept.size() == 1)
+                return std::move(kept[0]);
+
+            // Under AND the child most likely to rule a row out goes first;
+            // under OR, the one most likely to rule it in.
+            std::stable_sort(kept.begin(), kept.end(),
+                [is_and](const Node_Ptr& a, const Node_Ptr& b){
+                    return is_and ? a->selectivity < b->selectivity
+                                  : a->selectivity > b->selectivity;
+                });
+
+            double estimate = 1.0;
+            for(int i = 0; i < kept.size(); i++)
+                estimate *= is_and ? kept[i]->selectivity : 1.0 - kept[i]->selectivity;
+            node->selectivity = is_and ? estimate : 1.0 - estimate;
+            node->children.swap(kept);
+            return node;
+        }
+    }
+}
+
+std::string explain(const Node& node)
+{
+    switch(node.kind)
+    {
+    case Node::CONTAINS:
+        return (is_word(node.name) ? node.name : quote(node.name)) + " ~ " + quote(node.needle);
+    case Node::CONSTANT:
+        return node.value ? "TRUE" : "FALSE";
+    case Node::NOT:
+        return "NOT(" + explain(*node.children[0]) + ")";
+    default:
+        {
+            std::string out = node.kind == Node::AND ? "AND(" : "OR(";
+            for(int i = 0; i < node.children.size(); i++)
+                out += (i ? ", " : "") + explain(*node.children[i]);
+            return out + ")";
+        }
+    }
+}
+
+Select* compile(const Spreadsheet* sheet, const Node& node)
+{
+    switch(node.kind)
+    {
+    case Node::CONTAINS:
+        return new Select_Contains(sheet, node.column, node.needle);
+    case Node::CONSTANT:
+        return new Select_Constant(sheet, node.value);
+    case Node::NOT:
+        return new Select_Not(compile(sheet, *node.children[0]));
+    default:
+        {
+            // Left-deep chain, so the first (best) child is evaluated first.
+            Select* tree = compile(sheet, *node.children[0]);
+            for(int i = 1; i < node.children.size(); i++)
+            {
+                Select* next = compile(sheet, *node.children[i]);
+                if(node.kind == Node::AND)
+                    tree = new Select_And(tree, next);
+                else
+                    tree = new Select_Or(tree, next);
+            }
+            return tree;
+        }
+    }
+}
+
+}
+
+Query::Query(const Spreadsheet* sheet, const std::string& text)
+    : sheet(sheet), root(plan(sheet, Parser(text).parse()))
+{
+}
+
+std::string Query::explain() const
+{
+    return ::explain(*root);
+}
+
+Select* Query::compile() const
+{
+    return ::compile(sheet, *root);
+}
+
+double Query::selectivity() const
+{
+    return root->selectivity;
+}
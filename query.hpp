@@ -0,0 +1,65 @@
+#ifndef __QUERY_HPP__
+#define __QUERY_HPP__
+
+#include "spreadsheet.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class Select;
+
+// Thrown for malformed query text; position is the byte offset of the
+// offending token.
+class Query_Error: public std::runtime_error
+{
+    std::size_t where;
+
+public:
+    Query_Error(const std::string& message, std::size_t position)
+        : std::runtime_error(message), where(position) {}
+
+    std::size_t position() const { return where; }
+};
+
+// A text query compiled into an execution plan over the Select classes.
+//
+//     Last ~ "Dole" AND NOT First ~ "v"
+//     (First ~ "Amanda" OR Last ~ "on") AND NOT "Zip Code" ~ "9"
+//
+// `column ~ "text"` selects rows whose cell contains text; a column name
+// with spaces is written as a quoted string.  NOT binds tighter than AND,
+// which binds tighter than OR; keywords (including TRUE and FALSE) are
+// case-insensitive.  Inside quotes, \" and \\ stand for " and \.
+//
+// Planning resolves every column name once, folds constants (an unknown
+// column or empty needle decides the predicate outright), removes double
+// negation, flattens nested AND/OR, drops duplicate children, and orders
+// AND children most selective first and OR children least selective first,
+// using match rates sampled from the sheet.
+class Query
+{
+public:
+    struct Node;
+
+private:
+    const Spreadsheet* sheet;
+    std::shared_ptr<Node> root;
+
+public:
+    // Parse and plan.  Throws Query_Error on a syntax error.
+    Query(const Spreadsheet* sheet, const std::string& text);
+
+    // The optimized plan, e.g. AND(Last ~ "Dole", NOT(First ~ "v")).
+    std::string explain() const;
+
+    // Build a new Select tree for the plan.  The caller owns it, normally by
+    // handing it to Spreadsheet::set_selection.
+    Select* compile() const;
+
+    // Estimated fraction of rows the query selects.
+    double selectivity() const;
+};
+
+#endif //__QUERY_HPP__
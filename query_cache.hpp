@@ -0,0 +1,65 @@
+#ifndef __QUERY_CACHE_HPP__
+#define __QUERY_CACHE_HPP__
+
+#include "row_bitmap.hpp"
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Row sets computed by earlier selections, keyed by the fingerprint of the
+// predicate subtree that produced them.  Every entry belongs to one version
+// of the sheet; looking up under a newer version empties the cache.  Once
+// full, the oldest entry is evicted first.
+class Query_Cache
+{
+    std::unordered_map<std::string, Row_Bitmap> entries;
+    std::deque<std::string> order;
+    unsigned long version = 0;
+    int capacity = 0;
+
+    void sync(unsigned long sheet_version)
+    {
+        if(sheet_version == version)
+            return;
+        entries.clear();
+        order.clear();
+        version = sheet_version;
+    }
+
+public:
+    void set_capacity(int max_entries)
+    {
+        capacity = max_entries;
+        while(order.size() > capacity)
+        {
+            entries.erase(order.front());
+            order.pop_front();
+        }
+    }
+
+    bool enabled() const { return capacity > 0; }
+
+    const Row_Bitmap* find(const std::string& key, unsigned long sheet_version)
+    {
+        sync(sheet_version);
+        std::unordered_map<std::string, Row_Bitmap>::const_iterator it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+
+    void insert(const std::string& key, const Row_Bitmap& rows, unsigned long sheet_version)
+    {
+        sync(sheet_version);
+        if(capacity <= 0 || entries.count(key))
+            return;
+        if(order.size() >= capacity)
+        {
+            entries.erase(order.front());
+            order.pop_front();
+        }
+        entries.insert(std::make_pair(key, rows));
+        order.push_back(key);
+    }
+};
+
+#endif //__QUERY_CACHE_HPP__
@@ -0,0 +1,88 @@
+#include "query_pool.hpp"
+
+#include <vector>
+
+namespace
+{
+
+const int min_shift = 6;
+const int max_shift = 26;
+
+// Smallest size class that holds bytes, or -1 if it is too big to pool.
+int size_class(std::size_t bytes)
+{
+    int shift = min_shift;
+    while((std::size_t(1) << shift) < bytes)
+        if(++shift > max_shift)
+            return -1;
+    return shift - min_shift;
+}
+
+// Set once the calling thread's free lists have been destroyed at thread
+// exit; blocks freed after that go straight back to the heap.
+thread_local bool lists_gone = false;
+
+struct Free_Lists
+{
+    std::vector<void*> lists[max_shift - min_shift + 1];
+    std::size_t retained = 0;
+
+    ~Free_Lists()
+    {
+        lists_gone = true;
+        for(int c = 0; c <= max_shift - min_shift; c++)
+            for(int i = 0; i < lists[c].size(); i++)
+                ::operator delete(lists[c][i]);
+    }
+};
+
+Free_Lists& free_lists()
+{
+    static thread_local Free_Lists pool;
+    return pool;
+}
+
+}
+
+void* Query_Pool::allocate(std::size_t bytes)
+{
+    int c = size_class(bytes);
+    if(c < 0 || lists_gone)
+        return ::operator new(c < 0 ? bytes : std::size_t(1) << (c + min_shift));
+
+    Free_Lists& pool = free_lists();
+    std::vector<void*>& list = pool.lists[c];
+    if(list.empty())
+        return ::operator new(std::size_t(1) << (c + min_shift));
+    void* p = list.back();
+    list.pop_back();
+    pool.retained -= std::size_t(1) << (c + min_shift);
+    return p;
+}
+
+void Query_Pool::deallocate(void* p, std::size_t bytes)
+{
+    if(!p)
+        return;
+    int c = size_class(bytes);
+    if(c < 0 || lists_gone)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    Free_Lists& pool = free_lists();
+    std::size_t block = std::size_t(1) << (c + min_shift);
+    if(pool.retained + block > retained_limit)
+    {
+        ::operator delete(p);
+        return;
+    }
+    pool.lists[c].push_back(p);
+    pool.retained += block;
+}
+
+std::size_t Query_Pool::retained()
+{
+    return lists_gone ? 0 : free_lists().retained;
+}
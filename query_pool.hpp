@@ -0,0 +1,53 @@
+#ifndef __QUERY_POOL_HPP__
+#define __QUERY_POOL_HPP__
+
+#include <cstddef>
+#include <new>
+
+// Recycling allocator for selection nodes, their result bitmaps and the
+// scratch arrays of their scans.  Freed blocks go onto a per-thread free
+// list for their power-of-two size class and are handed straight back out
+// to the next query, so once a thread has built a query of a given shape,
+// building another one takes none of those from the general-purpose heap.
+// Strings are not covered: a needle longer than std::string's inline buffer
+// is still copied onto the heap (once for the node, once for its matcher),
+// as are fingerprints when the sheet has a result cache.  Each thread keeps
+// at most retained_limit bytes of free blocks; anything beyond that, and any
+// block larger than the biggest size class, goes back to the heap.
+class Query_Pool
+{
+public:
+    static const std::size_t retained_limit = std::size_t(64) << 20;
+
+    static void* allocate(std::size_t bytes);
+    static void deallocate(void* p, std::size_t bytes);
+
+    // Bytes sitting on the calling thread's free lists.
+    static std::size_t retained();
+};
+
+// Standard allocator interface over Query_Pool, for containers owned by
+// selections.
+template<class T>
+struct Pool_Allocator
+{
+    typedef T value_type;
+
+    Pool_Allocator() {}
+    template<class U> Pool_Allocator(const Pool_Allocator<U>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(Query_Pool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        Query_Pool::deallocate(p, n * sizeof(T));
+    }
+
+    template<class U> bool operator==(const Pool_Allocator<U>&) const { return true; }
+    template<class U> bool operator!=(const Pool_Allocator<U>&) const { return false; }
+};
+
+#endif //__QUERY_POOL_HPP__
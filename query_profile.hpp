@@ -0,0 +1,110 @@
+#ifndef __QUERY_PROFILE_HPP__
+#define __QUERY_PROFILE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Running totals kept by one selection node.  The counters are relaxed
+// atomics, bumped once per scanned chunk, so scans on the thread pool can
+// share them and they are cheap enough to leave on.  Lazy nodes would have
+// to bump them once per row, from every printing thread at once, so they
+// count only while per_row is set (see Spreadsheet::set_profiling).
+struct Select_Counters
+{
+    std::atomic<uint64_t> rows_scanned{0};
+    std::atomic<uint64_t> rows_matched{0};
+    std::atomic<uint64_t> bytes_compared{0};
+    std::atomic<uint64_t> nanoseconds{0};
+    bool per_row = false;
+
+    void add(uint64_t scanned, uint64_t matched, uint64_t bytes)
+    {
+        rows_scanned.fetch_add(scanned, std::memory_order_relaxed);
+        rows_matched.fetch_add(matched, std::memory_order_relaxed);
+        bytes_compared.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        rows_scanned = 0;
+        rows_matched = 0;
+        bytes_compared = 0;
+        nanoseconds = 0;
+    }
+};
+
+// Totals kept by Spreadsheet::print_selection.
+struct Print_Counters
+{
+    std::atomic<uint64_t> rows_emitted{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> nanoseconds{0};
+
+    void reset()
+    {
+        rows_emitted = 0;
+        bytes_written = 0;
+        nanoseconds = 0;
+    }
+};
+
+// Adds the wall time of its own lifetime to a counter.
+class Scoped_Timer
+{
+    std::atomic<uint64_t>& total;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit Scoped_Timer(std::atomic<uint64_t>& total)
+        : total(total), start(std::chrono::steady_clock::now()) {}
+
+    ~Scoped_Timer()
+    {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        total.fetch_add(elapsed.count(), std::memory_order_relaxed);
+    }
+};
+
+// One node of the installed selection, as listed by Spreadsheet::profile.
+struct Node_Profile
+{
+    std::string node;
+    int depth;
+    uint64_t rows_scanned;
+    uint64_t rows_matched;
+    uint64_t bytes_compared;
+    uint64_t nanoseconds;
+};
+
+// Snapshot of the counters since the selection was built or the profile was
+// last reset.  Nodes are listed parent first, children indented by depth.
+struct Query_Profile
+{
+    std::vector<Node_Profile> nodes;
+    uint64_t rows_emitted = 0;
+    uint64_t bytes_written = 0;
+    uint64_t print_nanoseconds = 0;
+
+    std::string str() const
+    {
+        std::ostringstream out;
+        for(int i = 0; i < nodes.size(); i++)
+        {
+            const Node_Profile& n = nodes[i];
+            out << std::string(2 * n.depth, ' ') << n.node
+                << ": scanned " << n.rows_scanned
+                << ", matched " << n.rows_matched
+                << ", compared " << n.bytes_compared << " bytes"
+                << ", " << n.nanoseconds / 1000 << " us\n";
+        }
+        out << "print: " << rows_emitted << " rows, " << bytes_written << " bytes, "
+            << print_nanoseconds / 1000 << " us\n";
+        return out.str();
+    }
+};
+
+#endif //__QUERY_PROFILE_HPP__
@@ -0,0 +1,102 @@
+#ifndef __ROW_BITMAP_HPP__
+#define __ROW_BITMAP_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "query_pool.hpp"
+
+// One bit per spreadsheet row, packed 64 rows to a word.  Selections keep
+// their result in this form so that And/Or/Not combine whole words at a time
+// instead of asking each child about every row.  Rows past size() read as
+// not selected.  The words come from Query_Pool, so a bitmap freed by one
+// query is reused by the next.
+class Row_Bitmap
+{
+    std::vector<uint64_t, Pool_Allocator<uint64_t> > words;
+    int bits = 0;
+
+    static int words_for(int size) { return (size + 63) / 64; }
+
+    // Zero the unused high bits of the last word so that count() and
+    // word-wise operations never see rows past the end.
+    void trim()
+    {
+        if(bits % 64)
+            words.back() &= (uint64_t(1) << (bits % 64)) - 1;
+    }
+
+public:
+    Row_Bitmap() {}
+    explicit Row_Bitmap(int size, bool value = false)
+        : words(words_for(size), value ? ~uint64_t(0) : 0), bits(size)
+    {
+        trim();
+    }
+
+    int size() const { return bits; }
+    int word_count() const { return words.size(); }
+    uint64_t word(int i) const { return words[i]; }
+    uint64_t* word_data() { return words.data(); }
+    const uint64_t* word_data() const { return words.data(); }
+
+    bool test(int row) const
+    {
+        if(row < 0 || row >= bits)
+            return false;
+        return (words[row / 64] >> (row % 64)) & 1;
+    }
+
+    void set(int row) { words[row / 64] |= uint64_t(1) << (row % 64); }
+    void reset(int row) { words[row / 64] &= ~(uint64_t(1) << (row % 64)); }
+
+    // Grow or shrink to size rows; new rows start unselected.
+    void resize(int size)
+    {
+        words.resize(words_for(size), 0);
+        bits = size;
+        trim();
+    }
+
+    void flip()
+    {
+        for(int i = 0; i < words.size(); i++)
+            words[i] = ~words[i];
+        trim();
+    }
+
+    // Rows the other bitmap does not cover count as unselected.
+    Row_Bitmap& operator&=(const Row_Bitmap& other)
+    {
+        int n = std::min(words.size(), other.words.size());
+        uint64_t* w = words.data();
+        const uint64_t* o = other.words.data();
+        for(int i = 0; i < n; i++)
+            w[i] &= o[i];
+        for(int i = n; i < words.size(); i++)
+            w[i] = 0;
+        return *this;
+    }
+
+    Row_Bitmap& operator|=(const Row_Bitmap& other)
+    {
+        int n = std::min(words.size(), other.words.size());
+        uint64_t* w = words.data();
+        const uint64_t* o = other.words.data();
+        for(int i = 0; i < n; i++)
+            w[i] |= o[i];
+        trim();
+        return *this;
+    }
+
+    int count() const
+    {
+        int total = 0;
+        for(int i = 0; i < words.size(); i++)
+            total += __builtin_popcountll(words[i]);
+        return total;
+    }
+};
+
+#endif //__ROW_BITMAP_HPP__
@@ -1,16 +1,158 @@
 #ifndef __SELECT_HPP__
 #define __SELECT_HPP__
+#include "spreadsheet.hpp"
+#include "row_bitmap.hpp"
+#include "thread_pool.hpp"
+#include "substring_search.hpp"
+#include "query_pool.hpp"
+#include "query_profile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <iostream>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 
 class Select
 {
+protected:
+    // Work done by this node itself, not counting its children.
+    mutable Select_Counters counters;
+
 public:
     virtual ~Select() = default;
 
+    // Nodes are recycled through Query_Pool rather than the general heap.
+    static void* operator new(std::size_t bytes) { return Query_Pool::allocate(bytes); }
+    static void operator delete(void* p, std::size_t bytes) { Query_Pool::deallocate(p, bytes); }
+
     // Return true if the specified row should be selected.
     virtual bool select(int row) const = 0;
     virtual int getRowSize() const = 0;
+
+    // The materialized result, one bit per row, or nullptr if this selection
+    // does not keep one.  Combinators use it to work a word at a time.
+    virtual const Row_Bitmap* bitmap() const { return nullptr; }
+
+    // Planner estimates used to order the children of lazy And/Or nodes:
+    // the expected work of one select() call, and the expected fraction of
+    // rows selected.
+    virtual double cost() const { return 1.0; }
+    virtual double selectivity() const { return 0.5; }
+
+    // A canonical description of the predicate subtree: two subtrees with
+    // the same fingerprint select the same rows of the same sheet.  Empty if
+    // the node cannot be described this way, which also keeps its ancestors
+    // out of the result cache.
+    virtual std::string fingerprint() const { return ""; }
+
+    // The sheet this selection reads, if known.
+    virtual const Spreadsheet* source() const { return nullptr; }
+
+    // Called by the sheet after rows are appended, with the new row count.
+    // Materialized selections evaluate only the new rows and grow their
+    // result in place; calling it again with the same count does nothing.
+    virtual void extend(int row_count) {}
+
+    // Instrumentation: a short name for the node, its direct children, and
+    // its counters.  Spreadsheet::profile walks the tree with these.
+    virtual std::string describe() const { return "Select"; }
+    virtual std::vector<const Select*> children() const { return std::vector<const Select*>(); }
+    const Select_Counters& statistics() const { return counters; }
+
+    // Zero the counters of this node and everything below it.
+    void reset_statistics() const
+    {
+        counters.reset();
+        std::vector<const Select*> below = children();
+        for(int i = 0; i < below.size(); i++)
+            below[i]->reset_statistics();
+    }
+
+    // Whether lazy nodes in this subtree count the rows they are asked about.
+    void count_rows(bool on) const
+    {
+        counters.per_row = on;
+        std::vector<const Select*> below = children();
+        for(int i = 0; i < below.size(); i++)
+            below[i]->count_rows(on);
+    }
+};
+
+// Base for selections that compute their result up front and answer select()
+// from a Row_Bitmap.
+class Select_Bitmap: public Select
+{
+protected:
+	Row_Bitmap chosenRows;
+
+	// A copy of the child's rows, falling back to asking it row by row if it
+	// has no bitmap of its own.
+	static Row_Bitmap rows_of(const Select* child)
+	{
+		if(const Row_Bitmap* b = child->bitmap())
+			return *b;
+		Row_Bitmap rows(child->getRowSize());
+		for(int i = 0; i < rows.size(); i++)
+			if(child->select(i))
+				rows.set(i);
+		return rows;
+	}
+
+	// The key to cache this node's result under, or "" if the sheet has no
+	// result cache or the node has no fingerprint.
+	std::string cache_key(const Spreadsheet* sheet) const {
+		return sheet && sheet->result_cache_enabled() ? fingerprint() : std::string();
+	}
+
+	// Fill chosenRows from the sheet's result cache; false on a miss.
+	bool load_cached(const Spreadsheet* sheet, const std::string& key) {
+		if(key.empty())
+			return false;
+		const Row_Bitmap* hit = sheet->cached_result(key);
+		if(hit)
+			chosenRows = *hit;
+		return hit;
+	}
+
+	// A result that does not cover every row of the sheet, e.g. one combined
+	// from children built before the last rows were added, is not stored:
+	// the cache only answers for the sheet as it is now.
+	void store_cached(const Spreadsheet* sheet, const std::string& key) const {
+		if(!key.empty() && chosenRows.size() == sheet->get_row_size())
+			sheet->cache_result(key, chosenRows);
+	}
+
+public:
+	void setSelection(int row) {
+		chosenRows.set(row);
+	}
+
+	virtual bool select(int row) const {
+		return chosenRows.test(row);
+	}
+
+	virtual int getRowSize() const {
+		return chosenRows.size();
+	}
+
+	virtual const Row_Bitmap* bitmap() const {
+		return &chosenRows;
+	}
+
+	// Looking up a bit is far cheaper than any predicate.
+	virtual double cost() const {
+		return 0.05;
+	}
+
+	virtual double selectivity() const {
+		return chosenRows.size() ? double(chosenRows.count()) / chosenRows.size() : 0.0;
+	}
 };
 
 // A common type of criterion for selection is to perform a comparison based on
@@ -20,166 +162,798 @@ public:
 // a string) and implements the original interface in terms of this.  Derived
 // classes need only implement the new select function.  You may choose to
 // derive from Select or Select_Column at your convenience.
+//
+// When the sheet is in Spreadsheet::LAZY evaluation mode the column is not
+// scanned up front; each select() call tests the one cell it is asked about.
 
-class Select_Contains: public Select
+class Select_Contains: public Select_Bitmap
 {
 protected:
+	const Spreadsheet* sheet;
 	int column;
-	bool* chosenRows;
-	int numRows;
+	std::string content;
+	Substring_Matcher matcher;
+	bool lazy;
+	double estimate;
+	// For a dictionary-encoded column, whether each distinct value contains
+	// the needle, so rows are matched by code without touching their bytes.
+	std::vector<char> value_hits;
+
+	const Column* encoded_store() const {
+		const Column* store = sheet->column_store(column);
+		return store && store->encoded() ? store : nullptr;
+	}
 
-public:
+	// Adds the number of cell bytes examined to bytes.
+	bool matches(int row, uint64_t& bytes) const {
+		if(!value_hits.empty()){
+			if(const Column* store = encoded_store()){
+				uint32_t code = store->code_data()[row];
+				if(code < value_hits.size())
+					return value_hits[code];
+			}
+		}
+		Cell_View cell = sheet->cell_data(row, column);
+		bytes += cell.size();
+		return matcher.contains(cell.data(), cell.size());
+	}
+
+	// Test the distinct values a dictionary-encoded column has gained since
+	// value_hits was last brought up to date.
+	void learn_values(){
+		const Column* store = encoded_store();
+		if(!store)
+			return;
+		uint64_t bytes = 0;
+		for(int code = value_hits.size(); code < store->distinct(); code++){
+			Cell_View value = store->value(code);
+			value_hits.push_back(matcher.contains(value.data(), value.size()));
+			bytes += value.size();
+		}
+		counters.add(0, 0, bytes);
+	}
+
+	// Estimate the match rate from a few rows spread over the column.
+	void sample(){
+		int rows = sheet->get_row_size();
+		int samples = std::min(rows, 64);
+		int hits = 0;
+		uint64_t bytes = 0;
+		for(int k = 0; k < samples; k++)
+			if(matches(int((long long)k * rows / samples), bytes))
+				hits++;
+		counters.add(samples, hits, bytes);
+		estimate = samples ? double(hits) / samples : 0.0;
+	}
 
-	~Select_Contains(){
-		delete chosenRows;
-	}
-	
-	Select_Contains(const Spreadsheet* sheet, const std::string& col, const std::string& content){				
-		
-		chosenRows = new bool[sheet->get_row_size()];
-		for(int i = 0; i < sheet->get_row_size(); i++)
-			chosenRows[i] = false;
-		
-		numRows = sheet->get_row_size();
-
-		column = sheet->get_column_by_name(col);
-		if(column != -1){
-			for(int i = 0; i < sheet->get_row_size(); i++){
-				if((sheet->cell_data(i, column)).find(content) != std::string::npos){
-					setSelection(i);
+	// Set the bits of the matching rows in [first, last); chosenRows must
+	// already cover them.  Whole 64-row words are built in a register and
+	// stored once.  Chunks handed to the thread pool start on word
+	// boundaries, so threads never write the same word.
+	void evaluate(int first, int last){
+		int aligned = std::min(last, (first + 63) / 64 * 64);
+		uint64_t bytes = 0, matched = 0;
+		for(int i = first; i < aligned; i++)
+			if(matches(i, bytes)){
+				chosenRows.set(i);
+				matched++;
+			}
+		counters.add(aligned - first, matched, bytes);
+		if(aligned >= last)
+			return;
+
+		// Blocks the column's zone map rules out are cleared without reading
+		// their cells.
+		std::vector<char, Pool_Allocator<char> > skip;
+		if(const Zone_Map* zones = sheet->zone_map(column)){
+			skip.resize((last + Zone_Map::block_rows - 1) / Zone_Map::block_rows);
+			for(int b = aligned / Zone_Map::block_rows; b < skip.size(); b++)
+				skip[b] = !zones->may_contain(b, content);
+		}
+		const char* pruned = skip.empty() ? nullptr : skip.data();
+
+		uint64_t* words = chosenRows.word_data();
+		const Column* store = value_hits.empty() ? nullptr : encoded_store();
+		auto scan = [this, words, store, pruned](int first, int last){
+			uint64_t bytes = 0, matched = 0, skipped = 0;
+			for(int base = first; base < last; base += 64){
+				if(pruned && pruned[base / Zone_Map::block_rows]){
+					words[base / 64] = 0;
+					skipped += std::min(64, last - base);
+					continue;
+				}
+				uint64_t word = 0;
+				int end = std::min(base + 64, last);
+				if(store){
+					const uint32_t* codes = store->code_data();
+					for(int i = base; i < end; i++)
+						word |= uint64_t(value_hits[codes[i]]) << (i - base);
 				}
+				else{
+					for(int i = base; i < end; i++)
+						if(matches(i, bytes))
+							word |= uint64_t(1) << (i - base);
+				}
+				words[base / 64] = word;
+				matched += __builtin_popcountll(word);
 			}
-							
-		}	
+			counters.add(last - first - skipped, matched, bytes);
+		};
+		if(Thread_Pool* pool = sheet->thread_pool())
+			pool->parallel_for(aligned, last, Spreadsheet::parallel_grain, scan);
+		else
+			scan(aligned, last);
 	}
 
-	void setSelection(int row) {
-        	chosenRows[row] = true;
+public:
+	Select_Contains(const Spreadsheet* sheet, const std::string& col, const std::string& content)
+		: Select_Contains(sheet, sheet->resolve_column(col), content){
+	}
+
+	Select_Contains(const Spreadsheet* sheet, Column_Handle col, const std::string& content)
+		: sheet(sheet), content(content), matcher(content),
+		  lazy(sheet->get_evaluation() == Spreadsheet::LAZY), estimate(0.0){
+		Scoped_Timer timer(counters.nanoseconds);
+		column = sheet->checked(col);
+		if(column != -1)
+			learn_values();
+		if(lazy){
+			if(column != -1)
+				sample();
+			return;
+		}
+
+		int rows = sheet->get_row_size();
+		chosenRows.resize(rows);
+		if(column == -1)
+			return;
+
+		std::string key = cache_key(sheet);
+		if(load_cached(sheet, key))
+			return;
+
+		// With a trigram index only the candidate rows need checking.
+		const Ngram_Index* index = sheet->ngram_index(column);
+		if(index && Ngram_Index::usable(content)){
+			std::vector<int> candidates = index->candidates(content);
+			uint64_t bytes = 0, matched = 0;
+			for(int k = 0; k < candidates.size(); k++)
+				if(candidates[k] < rows && matches(candidates[k], bytes)){
+					chosenRows.set(candidates[k]);
+					matched++;
+				}
+			counters.add(candidates.size(), matched, bytes);
+		}
+		else
+			evaluate(0, rows);
+		store_cached(sheet, key);
+	}
+
+	virtual void extend(int row_count) {
+		int old = chosenRows.size();
+		if(lazy || row_count <= old)
+			return;
+		Scoped_Timer timer(counters.nanoseconds);
+		chosenRows.resize(row_count);
+		if(column == -1)
+			return;
+		learn_values();
+		evaluate(old, row_count);
+	}
+
+	virtual std::string describe() const {
+		std::string name = column == -1 ? "?" : sheet->get_column_names()[column];
+		return "Contains(" + name + " ~ \"" + content + "\")";
+	}
+
+	virtual std::string fingerprint() const {
+		return "C" + std::to_string(column) + ":" + std::to_string(content.size()) + ":" + content;
+	}
+
+	virtual const Spreadsheet* source() const {
+		return sheet;
 	}
 
 	virtual bool select(int row) const {
-        	return chosenRows[row];
+		if(!lazy)
+			return chosenRows.test(row);
+		if(column == -1 || row < 0 || row >= sheet->get_row_size())
+			return false;
+		uint64_t bytes = 0;
+		bool hit = matches(row, bytes);
+		if(counters.per_row)
+			counters.add(1, hit, bytes);
+		return hit;
 	}
 
 	virtual int getRowSize() const {
-		return numRows;
+		return lazy ? sheet->get_row_size() : chosenRows.size();
 	}
 
+	virtual const Row_Bitmap* bitmap() const {
+		return lazy ? nullptr : &chosenRows;
+	}
+
+	// Roughly one pass over the cell per select(), plus a little per needle
+	// byte.
+	virtual double cost() const {
+		return lazy ? 1.0 + content.size() / 16.0 : Select_Bitmap::cost();
+	}
 
+	virtual double selectivity() const {
+		return lazy ? estimate : Select_Bitmap::selectivity();
+	}
 };
 
-class Select_Not: public Select
+// Base for predicates on a typed column: selects the rows whose value lies
+// between two bounds, either of which may be open or absent.  The bounds
+// are given as text and parsed as the column's type; std::invalid_argument
+// if they do not parse, and std::logic_error if the column is TEXT.  Null
+// cells never match.  The column is always scanned up front, whatever the
+// evaluation mode: the scan compares packed native values a block of 64
+// rows at a time, which the compiler turns into vector compares, and skips
+// blocks whose minimum and maximum rule the range out.
+class Select_Range: public Select_Bitmap
 {
 protected:
-	bool* chosenRows;
-	int rows;
+	const Spreadsheet* sheet;
+	int column;
+	std::string low, high;
+	bool has_low, has_high, low_open, high_open;
+	// Closed bounds in the column's own representation, and the type they
+	// were parsed as.
+	int64_t int_low, int_high;
+	double real_low, real_high;
+	Typed_Column::Type kind;
+	bool nothing;
+
+	Select_Range(const Spreadsheet* sheet, Column_Handle col)
+		: sheet(sheet), column(sheet->checked(col)), has_low(false), has_high(false),
+		  low_open(false), high_open(false), int_low(0), int_high(0),
+		  real_low(0.0), real_high(0.0), kind(Typed_Column::TEXT), nothing(false){
+	}
 
-public:
-	~Select_Not() {
-		delete chosenRows;
+	const Typed_Column* values() const {
+		const Typed_Column* typed = sheet->typed_column(column);
+		if(column != -1 && !typed)
+			throw std::logic_error("Select_Range needs a column with a numeric type");
+		return typed;
+	}
+
+	int64_t parse_int(const std::string& text) const {
+		int64_t value;
+		bool ok = values()->type() == Typed_Column::DATE
+			? Typed_Column::parse_date(text, value) : Typed_Column::parse_int(text, value);
+		if(!ok)
+			throw std::invalid_argument("Select_Range: bad bound \"" + text + "\"");
+		return value;
 	}
 
-	Select_Not(Select* first){
-		
-		rows = first->getRowSize();
-		chosenRows = new bool[rows];		
+	double parse_double(const std::string& text) const {
+		double value;
+		if(!Typed_Column::parse_double(text, value))
+			throw std::invalid_argument("Select_Range: bad bound \"" + text + "\"");
+		return value;
+	}
 
-		for(int i = 0; i < rows; i++){
-                        chosenRows[i] = false;
-			if(!first->select(i)){
-				setSelection(i);	
+	// Turn the text bounds into closed native bounds, then scan.
+	void run(){
+		Scoped_Timer timer(counters.nanoseconds);
+		int rows = sheet->get_row_size();
+		chosenRows.resize(rows);
+		const Typed_Column* typed = values();
+		if(!typed)
+			return;
+		kind = typed->type();
+		if(kind == Typed_Column::DOUBLE){
+			real_low = has_low ? parse_double(low) : -std::numeric_limits<double>::infinity();
+			real_high = has_high ? parse_double(high) : std::numeric_limits<double>::infinity();
+			if(low_open)
+				real_low = std::nextafter(real_low, std::numeric_limits<double>::infinity());
+			if(high_open)
+				real_high = std::nextafter(real_high, -std::numeric_limits<double>::infinity());
+			nothing = !(real_low <= real_high);
+		}
+		else{
+			int_low = has_low ? parse_int(low) : std::numeric_limits<int64_t>::min();
+			int_high = has_high ? parse_int(high) : std::numeric_limits<int64_t>::max();
+			if(low_open && int_low == std::numeric_limits<int64_t>::max())
+				nothing = true;
+			else if(low_open)
+				int_low++;
+			if(high_open && int_high == std::numeric_limits<int64_t>::min())
+				nothing = true;
+			else if(high_open)
+				int_high--;
+			nothing = nothing || int_low > int_high;
+		}
+
+		std::string key = cache_key(sheet);
+		if(load_cached(sheet, key))
+			return;
+		evaluate(0, rows);
+		store_cached(sheet, key);
+	}
+
+	// The rows of one block of at most 64 values that lie in [lo, hi].
+	// Comparing into a byte array first keeps the loop branch-free.
+	template<class T>
+	static uint64_t compare_block(const T* x, int n, T lo, T hi){
+		unsigned char hit[64];
+		for(int k = 0; k < n; k++)
+			hit[k] = (x[k] >= lo) & (x[k] <= hi);
+		uint64_t word = 0;
+		for(int k = 0; k < n; k++)
+			word |= uint64_t(hit[k]) << k;
+		return word;
+	}
+
+	template<class T>
+	void scan(const Typed_Column* typed, const T* data, T lo, T hi, int first, int last){
+		const Row_Bitmap& present = typed->present();
+		int aligned = std::min(last, (first + 63) / 64 * 64);
+		uint64_t matched = 0;
+		for(int i = first; i < aligned; i++)
+			if(present.test(i) && data[i] >= lo && data[i] <= hi){
+				chosenRows.set(i);
+				matched++;
+			}
+		counters.add(aligned - first, matched, (aligned - first) * sizeof(T));
+		if(aligned >= last)
+			return;
+
+		// Skip blocks whose smallest and largest values miss the range.
+		std::vector<char, Pool_Allocator<char> > skip((last + Zone_Map::block_rows - 1) / Zone_Map::block_rows);
+		for(int b = aligned / Zone_Map::block_rows; b < skip.size(); b++)
+			skip[b] = !typed->may_overlap(b, lo, hi);
+		const char* pruned = skip.data();
+
+		uint64_t* words = chosenRows.word_data();
+		const uint64_t* valid = present.word_data();
+		auto block = [this, data, lo, hi, words, valid, pruned](int first, int last){
+			uint64_t matched = 0, skipped = 0;
+			for(int base = first; base < last; base += 64){
+				if(pruned[base / Zone_Map::block_rows]){
+					words[base / 64] = 0;
+					skipped += std::min(64, last - base);
+					continue;
+				}
+				uint64_t word = compare_block(data + base, std::min(64, last - base), lo, hi);
+				word &= valid[base / 64];
+				words[base / 64] = word;
+				matched += __builtin_popcountll(word);
 			}
-		} 
+			counters.add(last - first - skipped, matched, (last - first - skipped) * sizeof(T));
+		};
+		if(Thread_Pool* pool = sheet->thread_pool())
+			pool->parallel_for(aligned, last, Spreadsheet::parallel_grain, block);
+		else
+			block(aligned, last);
 	}
 
-	void setSelection(int row) {
-		chosenRows[row] = true;
+	// Rows appended after the column was set back to TEXT, or to another
+	// type than the bounds were parsed as, match nothing.
+	void evaluate(int first, int last){
+		const Typed_Column* typed = sheet->typed_column(column);
+		if(!typed || typed->type() != kind || nothing || first >= last)
+			return;
+		if(typed->type() == Typed_Column::DOUBLE)
+			scan(typed, typed->real_data(), real_low, real_high, first, last);
+		else
+			scan(typed, typed->int_data(), int_low, int_high, first, last);
+	}
+
+public:
+	virtual void extend(int row_count) {
+		int old = chosenRows.size();
+		if(row_count <= old)
+			return;
+		Scoped_Timer timer(counters.nanoseconds);
+		chosenRows.resize(row_count);
+		evaluate(old, row_count);
+	}
+
+	virtual std::string describe() const {
+		std::string name = column == -1 ? "?" : sheet->get_column_names()[column];
+		return "Range(" + name + " in " + (low_open ? "(" : "[") + (has_low ? low : "-inf") + ", "
+			+ (has_high ? high : "inf") + (high_open ? ")" : "]") + ")";
+	}
+
+	virtual std::string fingerprint() const {
+		std::string out = "R" + std::to_string(column) + ":";
+		out += has_low ? (low_open ? "(" : "[") + std::to_string(low.size()) + ":" + low : "-";
+		out += has_high ? (high_open ? ")" : "]") + std::to_string(high.size()) + ":" + high : "-";
+		return out;
+	}
+
+	virtual const Spreadsheet* source() const {
+		return sheet;
 	}
+};
+
+// `column op value` against a typed column, e.g.
+//
+//     new Select_Compare(&sheet, "Age", Select_Compare::LESS, "21")
+class Select_Compare: public Select_Range
+{
+public:
+	enum Op { EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+	Select_Compare(const Spreadsheet* sheet, Column_Handle col, Op op, const std::string& value)
+		: Select_Range(sheet, col){
+		has_low = op == EQUAL || op == GREATER || op == GREATER_EQUAL;
+		has_high = op == EQUAL || op == LESS || op == LESS_EQUAL;
+		low_open = op == GREATER;
+		high_open = op == LESS;
+		if(has_low)
+			low = value;
+		if(has_high)
+			high = value;
+		run();
+	}
+
+	Select_Compare(const Spreadsheet* sheet, const std::string& col, Op op, const std::string& value)
+		: Select_Compare(sheet, sheet->resolve_column(col), op, value){
+	}
+};
+
+// low <= column <= high against a typed column.
+class Select_Between: public Select_Range
+{
+public:
+	Select_Between(const Spreadsheet* sheet, Column_Handle col, const std::string& low, const std::string& high)
+		: Select_Range(sheet, col){
+		this->low = low;
+		this->high = high;
+		has_low = has_high = true;
+		run();
+	}
+
+	Select_Between(const Spreadsheet* sheet, const std::string& col, const std::string& low, const std::string& high)
+		: Select_Between(sheet, sheet->resolve_column(col), low, high){
+	}
+};
+
+// Selects every row of the sheet, or none.  The query planner uses it for
+// subexpressions whose value it already knows.
+class Select_Constant: public Select_Bitmap
+{
+protected:
+	const Spreadsheet* sheet;
+	bool value;
+
+public:
+	Select_Constant(const Spreadsheet* sheet, bool value)
+		: sheet(sheet), value(value){
+		chosenRows = Row_Bitmap(sheet->get_row_size(), value);
+	}
+
+	virtual void extend(int row_count) {
+		int old = chosenRows.size();
+		if(row_count <= old)
+			return;
+		chosenRows.resize(row_count);
+		if(value)
+			for(int i = old; i < row_count; i++)
+				chosenRows.set(i);
+	}
+
+	virtual std::string describe() const {
+		return value ? "True" : "False";
+	}
+
+	virtual std::string fingerprint() const {
+		return value ? "T" : "F";
+	}
+
+	virtual const Spreadsheet* source() const {
+		return sheet;
+	}
+};
+
+// Select_Not, Select_And and Select_Or take ownership of their children and
+// delete them with themselves, so deleting the root frees the whole tree.
+// They combine their children's bitmaps when every child has one.  If any
+// child is lazy the combinator is lazy too: it keeps its children and
+// evaluates them per row in select(), short-circuiting And/Or and trying
+// the child most likely to decide the row first.
+
+class Select_Not: public Select_Bitmap
+{
+protected:
+	std::unique_ptr<Select> first;
+	bool lazy;
 
+public:
+	Select_Not(Select* first)
+		: first(first), lazy(!first->bitmap()){
+		if(lazy)
+			return;
+		Scoped_Timer timer(counters.nanoseconds);
+		std::string key = cache_key(source());
+		if(load_cached(source(), key))
+			return;
+		chosenRows = rows_of(first);
+		chosenRows.flip();
+		counters.add(chosenRows.size(), chosenRows.count(), 0);
+		store_cached(source(), key);
+	}
 
 	virtual bool select(int row) const {
-		return chosenRows[row];
+		if(!lazy)
+			return chosenRows.test(row);
+		bool hit = row >= 0 && row < first->getRowSize() && !first->select(row);
+		if(counters.per_row)
+			counters.add(1, hit, 0);
+		return hit;
 	}
 
 	virtual int getRowSize() const {
-		return rows;
+		return lazy ? first->getRowSize() : chosenRows.size();
+	}
+
+	virtual const Row_Bitmap* bitmap() const {
+		return lazy ? nullptr : &chosenRows;
+	}
+
+	virtual double cost() const {
+		return lazy ? first->cost() : Select_Bitmap::cost();
+	}
+
+	virtual double selectivity() const {
+		return lazy ? 1.0 - first->selectivity() : Select_Bitmap::selectivity();
+	}
+
+	virtual void extend(int row_count) {
+		first->extend(row_count);
+		int old = chosenRows.size();
+		if(lazy || row_count <= old)
+			return;
+		Scoped_Timer timer(counters.nanoseconds);
+		chosenRows.resize(row_count);
+		uint64_t matched = 0;
+		for(int i = old; i < row_count; i++)
+			if(!first->select(i)){
+				chosenRows.set(i);
+				matched++;
+			}
+		counters.add(row_count - old, matched, 0);
+	}
+
+	virtual std::string describe() const {
+		return "Not";
+	}
+
+	virtual std::vector<const Select*> children() const {
+		return std::vector<const Select*>(1, first.get());
+	}
+
+	virtual std::string fingerprint() const {
+		std::string child = first->fingerprint();
+		return child.empty() ? child : "N(" + child + ")";
+	}
+
+	virtual const Spreadsheet* source() const {
+		return first->source();
 	}
 };
 
-class Select_And: public Select
+// And and Or are commutative, so their fingerprints list the children in a
+// fixed order.
+inline std::string pair_fingerprint(char op, const Select* first, const Select* second)
+{
+	std::string a = first->fingerprint(), b = second->fingerprint();
+	if(a.empty() || b.empty())
+		return "";
+	if(b < a)
+		std::swap(a, b);
+	return std::string(1, op) + "(" + a + "," + b + ")";
+}
+
+class Select_And: public Select_Bitmap
 {
 protected:
-        bool* chosenRows;
-        int rows;
+        std::unique_ptr<Select> first;
+        std::unique_ptr<Select> second;
+        bool lazy;
 
 public:
-        ~Select_And() {
-                delete chosenRows;
+        Select_And(Select* first, Select* second)
+                : first(first), second(second), lazy(!first->bitmap() || !second->bitmap()){
+                if(lazy){
+                        // Run the child that rejects the most rows per unit
+                        // of work first.
+                        double rank1 = first->cost() / std::max(1.0 - first->selectivity(), 1e-6);
+                        double rank2 = second->cost() / std::max(1.0 - second->selectivity(), 1e-6);
+                        if(rank2 < rank1)
+                                std::swap(this->first, this->second);
+                        return;
+                }
+                Scoped_Timer timer(counters.nanoseconds);
+                std::string key = cache_key(source());
+                if(load_cached(source(), key))
+                        return;
+                // A child built before later rows were added is shorter
+                // than the other; bring it up to the same length so its
+                // missing rows are evaluated rather than read as unselected.
+                int rows = std::max(first->getRowSize(), second->getRowSize());
+                first->extend(rows);
+                second->extend(rows);
+                chosenRows = *first->bitmap();
+                chosenRows &= *second->bitmap();
+                counters.add(chosenRows.size(), chosenRows.count(), 0);
+                store_cached(source(), key);
         }
 
-        Select_And(Select* first, Select* second){
+        virtual bool select(int row) const {
+                if(!lazy)
+                        return chosenRows.test(row);
+                bool hit = first->select(row) && second->select(row);
+                if(counters.per_row)
+                        counters.add(1, hit, 0);
+                return hit;
+        }
 
+        virtual int getRowSize() const {
+                if(!lazy)
+                        return chosenRows.size();
+                return std::max(first->getRowSize(), second->getRowSize());
+        }
 
-                rows = first->getRowSize();
-                chosenRows = new bool[rows];
+        virtual const Row_Bitmap* bitmap() const {
+                return lazy ? nullptr : &chosenRows;
+        }
+
+        virtual double cost() const {
+                if(!lazy)
+                        return Select_Bitmap::cost();
+                return first->cost() + first->selectivity() * second->cost();
+        }
+
+        virtual double selectivity() const {
+                if(!lazy)
+                        return Select_Bitmap::selectivity();
+                return first->selectivity() * second->selectivity();
+        }
 
-                for(int i = 0; i < rows; i++){
-                        chosenRows[i] = false;
+        virtual void extend(int row_count) {
+                first->extend(row_count);
+                second->extend(row_count);
+                int old = chosenRows.size();
+                if(lazy || row_count <= old)
+                        return;
+                Scoped_Timer timer(counters.nanoseconds);
+                chosenRows.resize(row_count);
+                uint64_t matched = 0;
+                for(int i = old; i < row_count; i++)
                         if(first->select(i) && second->select(i)){
-                                setSelection(i);
+                                chosenRows.set(i);
+                                matched++;
                         }
-                }
+                counters.add(row_count - old, matched, 0);
         }
 
-        void setSelection(int row) {
-                chosenRows[row] = true;
+        virtual std::string describe() const {
+                return "And";
         }
 
+        virtual std::vector<const Select*> children() const {
+                std::vector<const Select*> both;
+                both.push_back(first.get());
+                both.push_back(second.get());
+                return both;
+        }
 
-        virtual bool select(int row) const {
-                return chosenRows[row];
+        virtual std::string fingerprint() const {
+                return pair_fingerprint('A', first.get(), second.get());
         }
 
-        virtual int getRowSize() const {
-                return rows;
+        virtual const Spreadsheet* source() const {
+                return first->source() ? first->source() : second->source();
         }
 };
 
-class Select_Or: public Select
+class Select_Or: public Select_Bitmap
 {
 protected:
-        bool* chosenRows;
-        int rows;
+        std::unique_ptr<Select> first;
+        std::unique_ptr<Select> second;
+        bool lazy;
 
 public:
-        ~Select_Or() {
-                delete chosenRows;
+        Select_Or(Select* first, Select* second)
+                : first(first), second(second), lazy(!first->bitmap() || !second->bitmap()){
+                if(lazy){
+                        // Run the child that accepts the most rows per unit
+                        // of work first.
+                        double rank1 = first->cost() / std::max(first->selectivity(), 1e-6);
+                        double rank2 = second->cost() / std::max(second->selectivity(), 1e-6);
+                        if(rank2 < rank1)
+                                std::swap(this->first, this->second);
+                        return;
+                }
+                Scoped_Timer timer(counters.nanoseconds);
+                std::string key = cache_key(source());
+                if(load_cached(source(), key))
+                        return;
+                // A child built before later rows were added is shorter
+                // than the other; bring it up to the same length so its
+                // missing rows are evaluated rather than read as unselected.
+                int rows = std::max(first->getRowSize(), second->getRowSize());
+                first->extend(rows);
+                second->extend(rows);
+                chosenRows = *first->bitmap();
+                chosenRows |= *second->bitmap();
+                counters.add(chosenRows.size(), chosenRows.count(), 0);
+                store_cached(source(), key);
+        }
+
+        virtual bool select(int row) const {
+                if(!lazy)
+                        return chosenRows.test(row);
+                bool hit = first->select(row) || second->select(row);
+                if(counters.per_row)
+                        counters.add(1, hit, 0);
+                return hit;
+        }
+
+        virtual int getRowSize() const {
+                if(!lazy)
+                        return chosenRows.size();
+                return std::max(first->getRowSize(), second->getRowSize());
         }
 
-        Select_Or(Select* first, Select* second){
+        virtual const Row_Bitmap* bitmap() const {
+                return lazy ? nullptr : &chosenRows;
+        }
+
+        virtual double cost() const {
+                if(!lazy)
+                        return Select_Bitmap::cost();
+                return first->cost() + (1.0 - first->selectivity()) * second->cost();
+        }
 
-                rows = first->getRowSize();
-                chosenRows = new bool[rows];
+        virtual double selectivity() const {
+                if(!lazy)
+                        return Select_Bitmap::selectivity();
+                double a = first->selectivity(), b = second->selectivity();
+                return a + b - a * b;
+        }
 
-                for(int i = 0; i < rows; i++){
-                        chosenRows[i] = false;
+        virtual void extend(int row_count) {
+                first->extend(row_count);
+                second->extend(row_count);
+                int old = chosenRows.size();
+                if(lazy || row_count <= old)
+                        return;
+                Scoped_Timer timer(counters.nanoseconds);
+                chosenRows.resize(row_count);
+                uint64_t matched = 0;
+                for(int i = old; i < row_count; i++)
                         if(first->select(i) || second->select(i)){
-                                setSelection(i);
+                                chosenRows.set(i);
+                                matched++;
                         }
-                }
+                counters.add(row_count - old, matched, 0);
         }
 
-        void setSelection(int row) {
-                chosenRows[row] = true;
+        virtual std::string describe() const {
+                return "Or";
         }
 
+        virtual std::vector<const Select*> children() const {
+                std::vector<const Select*> both;
+                both.push_back(first.get());
+                both.push_back(second.get());
+                return both;
+        }
 
-        virtual bool select(int row) const {
-                return chosenRows[row];
+        virtual std::string fingerprint() const {
+                return pair_fingerprint('O', first.get(), second.get());
         }
 
-        virtual int getRowSize() const {
-                return rows;
+        virtual const Spreadsheet* source() const {
+                return first->source() ? first->source() : second->source();
         }
 };
 
@@ -193,6 +967,11 @@ public:
     {
         column = sheet->get_column_by_name(name);
     }
+
+    Select_Column(const Spreadsheet* sheet, Column_Handle handle)
+    {
+        column = sheet->checked(handle);
+    }
 /*
     virtual bool select(const Spreadsheet* sheet, int row) const
     {
@@ -0,0 +1,137 @@
+#ifndef __SELECTION_RANGE_HPP__
+#define __SELECTION_RANGE_HPP__
+
+#include "spreadsheet.hpp"
+#include "select.hpp"
+
+#include <cstddef>
+#include <iterator>
+
+// One selected row.  Cells are returned as views into the sheet's storage;
+// nothing is copied.
+class Row_View
+{
+    const Spreadsheet* sheet;
+    int row;
+
+public:
+    Row_View(const Spreadsheet* sheet, int row) : sheet(sheet), row(row) {}
+
+    int index() const { return row; }
+    int size() const { return sheet->get_column_names().size(); }
+
+    Cell_View operator[](int column) const { return sheet->cell_data(row, column); }
+    Cell_View operator[](Column_Handle column) const { return sheet->cell_data(row, column); }
+};
+
+// Walks the rows chosen by the installed selection in increasing order.
+// When the selection keeps a bitmap, each step jumps straight to the next
+// set bit; a lazy selection is asked row by row; with no selection every
+// row is visited.
+class Selection_Iterator
+{
+    const Spreadsheet* sheet;
+    const Select* select;
+    int row;
+    int rows;
+
+    void seek()
+    {
+        if(!select)
+            return;
+        const Row_Bitmap* bits = select->bitmap();
+        if(!bits)
+        {
+            while(row < rows && !select->select(row))
+                row++;
+            return;
+        }
+        int limit = std::min(rows, bits->size());
+        const uint64_t* words = bits->word_data();
+        while(row < limit)
+        {
+            uint64_t word = words[row / 64] >> (row % 64);
+            if(word)
+            {
+                row += __builtin_ctzll(word);
+                break;
+            }
+            row = (row / 64 + 1) * 64;
+        }
+        if(row > limit)
+            row = limit;
+        if(row == limit)
+            row = rows;
+    }
+
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Row_View value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Row_View* pointer;
+    typedef Row_View reference;
+
+    Selection_Iterator(const Spreadsheet* sheet, int row)
+        : sheet(sheet), select(sheet->get_selection()), row(row), rows(sheet->get_row_size())
+    {
+        seek();
+    }
+
+    Row_View operator*() const { return Row_View(sheet, row); }
+
+    Selection_Iterator& operator++()
+    {
+        row++;
+        seek();
+        return *this;
+    }
+
+    Selection_Iterator operator++(int)
+    {
+        Selection_Iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    bool operator==(const Selection_Iterator& other) const { return row == other.row; }
+    bool operator!=(const Selection_Iterator& other) const { return row != other.row; }
+};
+
+// The selected rows of a sheet as a range, for range-for and the standard
+// algorithms:
+//
+//     for(Row_View row : sheet.selected_rows())
+//         use(row.index(), row[last]);
+//
+// Iterators are invalidated by set_selection and by adding rows.
+class Selection_Range
+{
+    const Spreadsheet* sheet;
+
+public:
+    explicit Selection_Range(const Spreadsheet* sheet) : sheet(sheet) {}
+
+    Selection_Iterator begin() const { return Selection_Iterator(sheet, 0); }
+    Selection_Iterator end() const { return Selection_Iterator(sheet, sheet->get_row_size()); }
+
+    // Number of selected rows; a popcount when the selection has a bitmap.
+    int size() const
+    {
+        const Select* select = sheet->get_selection();
+        if(!select)
+            return sheet->get_row_size();
+        if(const Row_Bitmap* bits = select->bitmap())
+            if(bits->size() <= sheet->get_row_size())
+                return bits->count();
+        return std::distance(begin(), end());
+    }
+
+    bool empty() const { return begin() == end(); }
+};
+
+inline Selection_Range Spreadsheet::selected_rows() const
+{
+    return Selection_Range(this);
+}
+
+#endif //__SELECTION_RANGE_HPP__
@@ -1,8 +1,12 @@
 #include "spreadsheet.hpp"
 #include "select.hpp"
+#include "thread_pool.hpp"
+#include "output_writer.hpp"
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
 
 Spreadsheet::~Spreadsheet()
 {
@@ -13,12 +17,30 @@ void Spreadsheet::set_selection(Select* new_select)
 {
     delete select;
     select = new_select;
+    // Its nodes may have been built before the last rows were added.
+    if(select)
+    {
+        select->extend(rows);
+        select->count_rows(profiling);
+    }
 }
 
 void Spreadsheet::clear()
 {
     column_names.clear();
-    data.clear();
+    column_index.clear();
+    schema++;
+    version++;
+    // The arenas keep their chunks for the next rows.
+    cells.clear();
+    row_start.assign(1, 0);
+    for(int j = 0; j < arenas.size(); j++)
+        arenas[j].reset();
+    columns.clear();
+    ngram_indexes.clear();
+    zone_maps.clear();
+    typed_columns.clear();
+    rows = 0;
     delete select;
     select = nullptr;
 }
@@ -26,50 +48,455 @@ void Spreadsheet::clear()
 void Spreadsheet::set_column_names(const std::vector<std::string>& names)
 {
     column_names=names;
+
+    // With duplicate names the first column wins, as before.
+    column_index.clear();
+    column_index.reserve(names.size());
+    for(int i = 0; i < names.size(); i++)
+        column_index.insert(std::make_pair(names[i], i));
+    schema++;
+    version++;
+}
+
+void Spreadsheet::widen_columns(int width)
+{
+    // A row wider than any before it adds columns, padded with empty cells
+    // for the rows already stored.
+    while(columns.size() < width)
+    {
+        columns.push_back(Column());
+        for(int i = 0; i < rows; i++)
+            columns.back().append("", 0);
+    }
+}
+
+template<class Cells>
+void Spreadsheet::append_row(const Cells& row_cells, int count)
+{
+    if(storage == COLUMN_MAJOR)
+    {
+        widen_columns(count);
+        for(int j = 0; j < columns.size(); j++)
+        {
+            if(j < count)
+                columns[j].append(row_cells[j].data(), row_cells[j].size());
+            else
+                columns[j].append("", 0);
+        }
+    }
+    else
+    {
+        if(arenas.size() < count)
+            arenas.resize(count);
+        for(int j = 0; j < count; j++)
+            cells.push_back(Cell_View(arenas[j].store(row_cells[j].data(), row_cells[j].size()), row_cells[j].size()));
+        row_start.push_back(cells.size());
+    }
+    rows++;
+    version++;
+    if(!ngram_indexes.empty() || !zone_maps.empty() || !typed_columns.empty())
+        index_row(rows - 1);
+    if(select)
+        select->extend(rows);
 }
 
 void Spreadsheet::add_row(const std::vector<std::string>& row_data)
 {
-    data.push_back(row_data);
+    append_row(row_data, row_data.size());
+}
+
+void Spreadsheet::add_row(std::vector<std::string>&& row_data)
+{
+    // The bytes are copied into the arenas either way; taking the row by
+    // rvalue just saves the caller a copy of the vector.
+    add_row(static_cast<const std::vector<std::string>&>(row_data));
+}
+
+void Spreadsheet::reserve(int total_rows)
+{
+    if(storage == COLUMN_MAJOR)
+    {
+        for(int j = 0; j < columns.size(); j++)
+            columns[j].reserve(total_rows, 0);
+    }
+    else
+    {
+        cells.reserve(std::size_t(total_rows) * std::max<std::size_t>(arenas.size(), column_names.size()));
+        row_start.reserve(total_rows + 1);
+    }
+}
+
+void Spreadsheet::add_row(const Cell_View* row_cells, int count)
+{
+    append_row(row_cells, count);
+}
+
+void Spreadsheet::set_storage(Storage new_storage)
+{
+    if(new_storage == storage)
+        return;
+
+    if(new_storage == COLUMN_MAJOR)
+    {
+        int width = arenas.size();
+        std::vector<std::size_t> bytes(width, 0);
+        for(int i = 0; i < rows; i++)
+            for(std::size_t k = row_start[i]; k < row_start[i + 1]; k++)
+                bytes[k - row_start[i]] += cells[k].size();
+
+        columns.assign(width, Column());
+        for(int j = 0; j < width; j++)
+        {
+            columns[j].reserve(rows, bytes[j]);
+            for(int i = 0; i < rows; i++)
+            {
+                if(j < row_start[i + 1] - row_start[i])
+                {
+                    const Cell_View& cell = cells[row_start[i] + j];
+                    columns[j].append(cell.data(), cell.size());
+                }
+                else
+                    columns[j].append("", 0);
+            }
+        }
+        std::vector<Cell_View>().swap(cells);
+        row_start.assign(1, 0);
+        std::vector<Cell_Arena>().swap(arenas);
+    }
+    else
+    {
+        int width = columns.size();
+        arenas.resize(width);
+        cells.reserve(std::size_t(rows) * width);
+        row_start.reserve(rows + 1);
+        for(int i = 0; i < rows; i++)
+        {
+            for(int j = 0; j < width; j++)
+            {
+                Cell_View cell = columns[j].at(i);
+                cells.push_back(Cell_View(arenas[j].store(cell.data(), cell.size()), cell.size()));
+            }
+            row_start.push_back(cells.size());
+        }
+        std::vector<Column>().swap(columns);
+    }
+    storage = new_storage;
+}
+
+void Spreadsheet::index_row(int row)
+{
+    for(int j = 0; j < ngram_indexes.size(); j++)
+        if(ngram_indexes[j] && has_cell(row, j))
+            ngram_indexes[j]->add(row, cell_data(row, j));
+    for(int j = 0; j < zone_maps.size(); j++)
+        if(zone_maps[j])
+            zone_maps[j]->add(row, has_cell(row, j) ? cell_data(row, j) : Cell_View());
+    for(int j = 0; j < typed_columns.size(); j++)
+        if(typed_columns[j])
+            typed_columns[j]->append(has_cell(row, j) ? cell_data(row, j) : Cell_View());
+}
+
+void Spreadsheet::set_ngram_index(Column_Handle column, bool enabled)
+{
+    int j = checked(column);
+    if(j == -1)
+        throw std::out_of_range("Spreadsheet: no such column");
+    if(!enabled)
+    {
+        if(j < ngram_indexes.size())
+            ngram_indexes[j].reset();
+        return;
+    }
+    if(ngram_index(j))
+        return;
+
+    if(ngram_indexes.size() <= j)
+        ngram_indexes.resize(j + 1);
+    std::unique_ptr<Ngram_Index> index(new Ngram_Index);
+    for(int i = 0; i < rows; i++)
+        if(has_cell(i, j))
+            index->add(i, cell_data(i, j));
+    ngram_indexes[j] = std::move(index);
+}
+
+void Spreadsheet::set_zone_map(Column_Handle column, bool enabled)
+{
+    int j = checked(column);
+    if(j == -1)
+        throw std::out_of_range("Spreadsheet: no such column");
+    if(!enabled)
+    {
+        if(j < zone_maps.size())
+            zone_maps[j].reset();
+        return;
+    }
+    if(zone_map(j))
+        return;
+
+    if(zone_maps.size() <= j)
+        zone_maps.resize(j + 1);
+    std::unique_ptr<Zone_Map> zones(new Zone_Map);
+    for(int i = 0; i < rows; i++)
+        zones->add(i, has_cell(i, j) ? cell_data(i, j) : Cell_View());
+    zone_maps[j] = std::move(zones);
+}
+
+void Spreadsheet::set_column_type(Column_Handle column, Typed_Column::Type type)
+{
+    int j = checked(column);
+    if(j == -1)
+        throw std::out_of_range("Spreadsheet: no such column");
+    if(type == Typed_Column::TEXT)
+    {
+        if(j < typed_columns.size())
+            typed_columns[j].reset();
+        return;
+    }
+    if(typed_column(j) && typed_column(j)->type() == type)
+        return;
+
+    if(typed_columns.size() <= j)
+        typed_columns.resize(j + 1);
+    std::unique_ptr<Typed_Column> values(new Typed_Column(type));
+    for(int i = 0; i < rows; i++)
+        values->append(has_cell(i, j) ? cell_data(i, j) : Cell_View());
+    typed_columns[j] = std::move(values);
+    version++;
+}
+
+void Spreadsheet::set_dictionary_encoded(Column_Handle column, bool encoded)
+{
+    if(storage != COLUMN_MAJOR)
+        throw std::logic_error("Dictionary encoding needs COLUMN_MAJOR storage");
+    int j = checked(column);
+    if(j == -1)
+        throw std::out_of_range("Spreadsheet: no such column");
+    widen_columns(j + 1);
+    columns[j].set_encoded(encoded);
+}
+
+Cell_Ref& Cell_Ref::operator=(const std::string& value)
+{
+    sheet->version++;
+    if(sheet->storage == Spreadsheet::COLUMN_MAJOR)
+        sheet->columns.at(column).assign(row, value.data(), value.size());
+    else
+    {
+        // The old bytes stay in the arena until the sheet is cleared.
+        std::size_t k = sheet->cell_index(row, column);
+        sheet->cells[k] = Cell_View(sheet->arenas[column].store(value.data(), value.size()), value.size());
+    }
+    if(Ngram_Index* index = column < sheet->ngram_indexes.size() ? sheet->ngram_indexes[column].get() : nullptr)
+        index->add(row, value);
+    if(Zone_Map* zones = column < sheet->zone_maps.size() ? sheet->zone_maps[column].get() : nullptr)
+        zones->add(row, value);
+    if(Typed_Column* values = column < sheet->typed_columns.size() ? sheet->typed_columns[column].get() : nullptr)
+        values->assign(row, value);
+    return *this;
+}
+
+void Spreadsheet::set_thread_count(int threads)
+{
+    if(threads == get_thread_count())
+        return;
+    pool.reset(threads > 1 ? new Thread_Pool(threads) : nullptr);
+}
+
+int Spreadsheet::get_thread_count() const
+{
+    return pool ? pool->size() : 1;
 }
 
 int Spreadsheet::get_column_by_name(const std::string& name) const
 {
-    for(int i=0; i<column_names.size(); i++)
-        if(column_names.at(i) == name)
-            return i;
-    return -1;
-}
-
-void Spreadsheet::print_selection(std::ostream& out) const{
-
-	if(select == NULL){
-		
-		for(int i = 0; i < data.size(); i++) {
-			for(int j = 0; j < column_names.size(); j++) {
-				if(j + 1 == column_names.size())
-					out << cell_data(i, j);
-				else
-				out << cell_data(i, j) << " ";	
-				}
-			out << std::endl;
-		}
-	}
-
-
-	else {
-	for(int i = 0; i < data.size(); i++){
-		if(select->select(i)){
-			
-			for(int j = 0; j < column_names.size(); j++){
-				if(j + 1 == column_names.size())
-					out << cell_data(i, j);
-				else
-					out << cell_data(i, j) << " ";
-			}
-		out << std::endl;	
-		}
-	}
-	}
+    auto it = column_index.find(name);
+    return it == column_index.end() ? -1 : it->second;
+}
+
+int Spreadsheet::require_column(const std::string& name) const
+{
+    int column = get_column_by_name(name);
+    if(column == -1)
+        throw std::out_of_range("Spreadsheet: no column named " + name);
+    return column;
 }
 
+std::vector<int> Spreadsheet::require_columns(const std::vector<std::string>& names) const
+{
+    std::vector<int> columns(names.size());
+    for(int k = 0; k < names.size(); k++)
+        columns[k] = require_column(names[k]);
+    return columns;
+}
+
+void Spreadsheet::row_key(int row, const std::vector<int>& columns, std::string& key) const
+{
+    key.clear();
+    for(int k = 0; k < columns.size(); k++)
+    {
+        Cell_View cell = cell_data(row, columns[k]);
+        uint32_t length = cell.size();
+        key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        key.append(cell.data(), cell.size());
+    }
+}
+
+Column_Handle Spreadsheet::resolve_column(const std::string& name) const
+{
+    Column_Handle handle;
+    handle.column = get_column_by_name(name);
+    handle.schema = schema;
+    return handle;
+}
+
+int Spreadsheet::checked(Column_Handle column) const
+{
+    if(column.schema != schema)
+        throw std::logic_error("Column_Handle used after the column names changed");
+    return column.column;
+}
+
+void Spreadsheet::format_row(int row, const std::vector<int>& fields, std::string& buffer) const
+{
+    for(int j = 0; j < fields.size(); j++)
+    {
+        Cell_View cell = cell_data(row, fields[j]);
+        buffer.append(cell.data(), cell.size());
+        buffer += j + 1 == fields.size() ? '\n' : ' ';
+    }
+    if(fields.empty())
+        buffer += '\n';
+}
+
+int Spreadsheet::format_rows(int begin, int end, const std::vector<int>& fields, std::string& buffer) const
+{
+    int emitted = 0;
+    for(int i = begin; i < end; i++)
+    {
+        if(select && !select->select(i))
+            continue;
+        emitted++;
+        format_row(i, fields, buffer);
+    }
+    return emitted;
+}
+
+void Spreadsheet::print_selection(std::ostream& out) const
+{
+    Output_Writer writer(out);
+    print_selection(writer);
+}
+
+void Spreadsheet::print_selection(int fd) const
+{
+    Output_Writer writer(fd);
+    print_selection(writer);
+}
+
+void Spreadsheet::print_selection(Output_Writer& writer) const
+{
+    std::vector<int> fields(column_names.size());
+    for(int j = 0; j < fields.size(); j++)
+        fields[j] = j;
+    print_fields(writer, fields);
+}
+
+void Spreadsheet::print_selection(std::ostream& out, const std::vector<std::string>& names) const
+{
+    Output_Writer writer(out);
+    print_selection(writer, names);
+}
+
+void Spreadsheet::print_selection(int fd, const std::vector<std::string>& names) const
+{
+    Output_Writer writer(fd);
+    print_selection(writer, names);
+}
+
+void Spreadsheet::print_selection(Output_Writer& writer, const std::vector<std::string>& names) const
+{
+    print_fields(writer, require_columns(names));
+}
+
+void Spreadsheet::print_fields(Output_Writer& writer, const std::vector<int>& fields) const
+{
+    Scoped_Timer timer(print_counters.nanoseconds);
+    uint64_t emitted = 0, written = 0;
+    if(pool && rows > parallel_grain)
+    {
+        // Format a batch of chunks in parallel, then write them out in row
+        // order so the output matches the serial path exactly.
+        int batch = pool->size() * 4;
+        std::vector<std::string> chunks(batch);
+        for(int base = 0; base < rows; base += batch * parallel_grain)
+        {
+            int end = std::min<long long>(rows, base + (long long)batch * parallel_grain);
+            pool->parallel_for(base, end, parallel_grain, [&](int first, int last) {
+                std::string& chunk = chunks[(first - base) / parallel_grain];
+                chunk.clear();
+                int n = format_rows(first, last, fields, chunk);
+                print_counters.rows_emitted.fetch_add(n, std::memory_order_relaxed);
+            });
+            for(int c = 0; c * parallel_grain < end - base; c++)
+            {
+                writer.write(chunks[c].data(), chunks[c].size());
+                written += chunks[c].size();
+            }
+        }
+    }
+    else
+    {
+        const int block = 1024;
+        for(int base = 0; base < rows; base += block)
+        {
+            std::size_t before = writer.data().size();
+            emitted += format_rows(base, std::min(base + block, rows), fields, writer.data());
+            written += writer.data().size() - before;
+            writer.maybe_flush();
+        }
+    }
+    print_counters.rows_emitted.fetch_add(emitted, std::memory_order_relaxed);
+    print_counters.bytes_written.fetch_add(written, std::memory_order_relaxed);
+    writer.flush();
+}
+
+namespace
+{
+
+void profile_node(const Select* node, int depth, std::vector<Node_Profile>& out)
+{
+    const Select_Counters& c = node->statistics();
+    Node_Profile entry = {node->describe(), depth, c.rows_scanned, c.rows_matched,
+                          c.bytes_compared, c.nanoseconds};
+    out.push_back(entry);
+    std::vector<const Select*> children = node->children();
+    for(int i = 0; i < children.size(); i++)
+        profile_node(children[i], depth + 1, out);
+}
+
+}
+
+Query_Profile Spreadsheet::profile() const
+{
+    Query_Profile report;
+    if(select)
+        profile_node(select, 0, report.nodes);
+    report.rows_emitted = print_counters.rows_emitted;
+    report.bytes_written = print_counters.bytes_written;
+    report.print_nanoseconds = print_counters.nanoseconds;
+    return report;
+}
+
+void Spreadsheet::reset_profile()
+{
+    print_counters.reset();
+    if(select)
+        select->reset_statistics();
+}
+
+void Spreadsheet::set_profiling(bool on)
+{
+    profiling = on;
+    if(select)
+        select->count_rows(on);
+}
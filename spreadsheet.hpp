@@ -1,44 +1,448 @@
 #ifndef __SPREADSHEET_HPP__
 #define __SPREADSHEET_HPP__
 
+#include "cell_view.hpp"
+#include "column.hpp"
+#include "cell_arena.hpp"
+#include "ngram_index.hpp"
+#include "typed_column.hpp"
+#include "zone_map.hpp"
+#include "query_cache.hpp"
+#include "query_profile.hpp"
+
 #include <string>
 #include <initializer_list>
 #include <vector>
 #include <iosfwd>
+#include <iterator>
+#include <utility>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
 
 class Select;
+class Thread_Pool;
+class Output_Writer;
+class Selection_Range;
+class Spreadsheet;
+
+// Writable handle to one cell, returned by the non-const cell_data.  Reading
+// goes through Cell_View; assigning stores the new value in whichever
+// backend the sheet is using.
+class Cell_Ref
+{
+    Spreadsheet* sheet;
+    int row;
+    int column;
+
+public:
+    Cell_Ref(Spreadsheet* sheet, int row, int column)
+        : sheet(sheet), row(row), column(column) {}
+
+    Cell_View view() const;
+    operator Cell_View() const { return view(); }
+    operator std::string() const { return view().str(); }
+    std::string str() const { return view().str(); }
+    std::size_t size() const { return view().size(); }
+    std::size_t find(const std::string& needle, std::size_t pos = 0) const
+    {
+        return view().find(needle, pos);
+    }
+
+    Cell_Ref& operator=(const std::string& value);
+    Cell_Ref& operator=(const char* value) { return *this = std::string(value); }
+    Cell_Ref& operator=(const Cell_Ref& other) { return *this = other.str(); }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Cell_Ref& cell)
+{
+    return out << cell.view();
+}
+
+// One column of an ORDER BY.  Typed columns (see set_column_type) sort by
+// value with nulls last in either direction; other columns sort by their
+// bytes.
+struct Sort_Key
+{
+    std::string column;
+    bool descending;
+
+    Sort_Key(const std::string& column, bool descending = false)
+        : column(column), descending(descending) {}
+    Sort_Key(const char* column, bool descending = false)
+        : column(column), descending(descending) {}
+};
+
+// One output column of Spreadsheet::group_by.  COUNT counts the rows of
+// the group and ignores column.  The others read the column as numbers:
+// the parsed values of a typed column, or else each cell's text as a
+// double.  Cells that are not numbers are skipped.
+struct Aggregate
+{
+    enum Function { COUNT, SUM, MIN, MAX, AVG };
+
+    Function function;
+    std::string column;
+
+    Aggregate(Function function, const std::string& column = "")
+        : function(function), column(column) {}
+};
+
+// One group: its key cells, then one value per Aggregate.  A group with no
+// numeric values for an aggregate other than COUNT or SUM gets NaN.
+struct Group_Row
+{
+    std::vector<std::string> keys;
+    std::vector<double> values;
+};
+
+// A column resolved once by name.  Handles stay valid until the sheet's
+// column names change; using one after that throws std::logic_error.
+class Column_Handle
+{
+    int column = -1;
+    unsigned schema = 0;
+
+    friend class Spreadsheet;
+
+public:
+    Column_Handle() {}
+
+    // Index of the column, or -1 if the name did not match any column.
+    int index() const { return column; }
+    bool valid() const { return column != -1; }
+};
 
 class Spreadsheet
 {
+public:
+    // ROW_MAJOR keeps a table of cells row after row, with the cell bytes
+    // bump-allocated from one Cell_Arena per column.  COLUMN_MAJOR keeps one
+    // Column (contiguous arena + offsets) per column, which makes scans down a
+    // single column sequential.
+    enum Storage { ROW_MAJOR, COLUMN_MAJOR };
+
+    // EAGER selections scan their columns when they are constructed.  LAZY
+    // selections are only built as a tree and test a row when asked, so
+    // print_selection drives the evaluation and And/Or can short-circuit.
+    enum Evaluation { EAGER, LAZY };
+
+private:
     std::vector<std::string> column_names;
-    std::vector<std::vector<std::string> > data;
+    std::unordered_map<std::string, int> column_index;
+    unsigned schema = 0;
+    std::vector<Cell_View> cells;
+    std::vector<std::size_t> row_start = std::vector<std::size_t>(1, 0);
+    std::vector<Cell_Arena> arenas;
+    std::vector<Column> columns;
+    int rows = 0;
+    Storage storage = ROW_MAJOR;
+    Evaluation evaluation = EAGER;
+    bool profiling = false;
     Select* select = nullptr;
+    std::unique_ptr<Thread_Pool> pool;
+    unsigned long version = 0;
+    mutable Query_Cache cache;
+    mutable Print_Counters print_counters;
+    // Trigram indexes by column index; null for unindexed columns.
+    std::vector<std::unique_ptr<Ngram_Index> > ngram_indexes;
+    // Per-block summaries by column index; null where not enabled.
+    std::vector<std::unique_ptr<Zone_Map> > zone_maps;
+    // Parsed values by column index; null for TEXT columns.
+    std::vector<std::unique_ptr<Typed_Column> > typed_columns;
+
+    friend class Cell_Ref;
+
+    void widen_columns(int width);
+
+    // The body of every add_row: store count cells, where row_cells[j] has
+    // data() and size(), then update the indexes and the selection.
+    template<class Cells>
+    void append_row(const Cells& row_cells, int count);
+
+    // Whether a row has a cell in this column.
+    bool has_cell(int row, int column) const
+    {
+        if(storage == COLUMN_MAJOR)
+            return column < columns.size();
+        return column < row_start[row + 1] - row_start[row];
+    }
+
+    // Add a newly appended row to the trigram indexes, zone maps and typed
+    // columns.
+    void index_row(int row);
+
+    // Index into cells of a ROW_MAJOR cell; throws std::out_of_range.
+    std::size_t cell_index(int row, int column) const
+    {
+        if(row < 0 || row >= rows)
+            throw std::out_of_range("Spreadsheet: row out of range");
+        std::size_t first = row_start[row];
+        if(column < 0 || column >= row_start[row + 1] - first)
+            throw std::out_of_range("Spreadsheet: column out of range");
+        return first + column;
+    }
+
+    static Cell_View as_view(const std::string& s) { return Cell_View(s); }
+    static Cell_View as_view(const char* s) { return Cell_View(s, std::strlen(s)); }
+    static Cell_View as_view(Cell_View s) { return s; }
+
+    template<class Iterator>
+    void reserve_for(Iterator first, Iterator last, std::forward_iterator_tag)
+    {
+        reserve(rows + std::distance(first, last));
+    }
+
+    template<class Iterator>
+    void reserve_for(Iterator, Iterator, std::input_iterator_tag) {}
+
+    // Append the given columns of one row to buffer in print format.
+    void format_row(int row, const std::vector<int>& fields, std::string& buffer) const;
+
+    // Append the given columns of the selected rows in [begin, end) to
+    // buffer in print format; returns how many rows were appended.
+    int format_rows(int begin, int end, const std::vector<int>& fields, std::string& buffer) const;
+    void print_fields(Output_Writer& writer, const std::vector<int>& fields) const;
 
 public:
     ~Spreadsheet();
 
-    const std::string& cell_data(int row, int column) const
+    Cell_View cell_data(int row, int column) const
+    {
+        if(storage == COLUMN_MAJOR)
+            return columns.at(column).at(row);
+        return cells[cell_index(row, column)];
+    }
+
+    Cell_Ref cell_data(int row, int column)
     {
-        return data.at(row).at(column);
+        return Cell_Ref(this, row, column);
     }
 
-    std::string& cell_data(int row, int column)
+    Cell_View cell_data(int row, Column_Handle column) const
     {
-        return data.at(row).at(column);
+        return cell_data(row, checked(column));
     }
 
+    Cell_Ref cell_data(int row, Column_Handle column)
+    {
+        return Cell_Ref(this, row, checked(column));
+    }
+
+    // Install the selection used by print_selection.  Rows added since its
+    // nodes were built are evaluated on install, and it is kept up to date
+    // as rows are appended: only the new rows are evaluated.
     void set_selection(Select* new_select);
+    const Select* get_selection() const { return select; }
+
+    // The selected rows as an iterable range of Row_Views, for consuming a
+    // selection without going through text.  Defined in selection_range.hpp.
+    Selection_Range selected_rows() const;
 
-    // TODO: Implement print_selection.
+    // Print the selected rows, one per line with cells separated by spaces.
+    // Output is buffered and written in large blocks; the fd overload writes
+    // straight to a file descriptor without going through iostreams.
     void print_selection(std::ostream& out) const;
+    void print_selection(int fd) const;
+    void print_selection(Output_Writer& writer) const;
+
+    // Print only the named columns, in the order given, in the same format.
+    // Names are resolved once per call; other columns are never read.
+    // Throws std::out_of_range for a name that matches no column.
+    void print_selection(std::ostream& out, const std::vector<std::string>& columns) const;
+    void print_selection(int fd, const std::vector<std::string>& columns) const;
+    void print_selection(Output_Writer& writer, const std::vector<std::string>& columns) const;
+
+    // The selected rows ordered by the keys, earlier keys first, with ties
+    // left in row order.  With a limit of zero or more only the first limit
+    // rows are produced, using a heap of that many rows instead of sorting
+    // the whole selection.  Throws std::out_of_range for an unknown column.
+    std::vector<int> sorted_rows(const std::vector<Sort_Key>& order, int limit = -1) const;
+
+    // Group the selected rows by the key columns and compute the aggregates
+    // of each group in one pass.  On a sheet with a thread pool each chunk of
+    // rows fills its own hash table and the tables are merged at the end.
+    // Groups are listed in order of their first row.  Throws
+    // std::out_of_range for an unknown column.
+    std::vector<Group_Row> group_by(const std::vector<std::string>& keys,
+                                    const std::vector<Aggregate>& aggregates) const;
+
+    // print_selection in that order.
+    void print_sorted(std::ostream& out, const std::vector<Sort_Key>& order, int limit = -1) const;
+    void print_sorted(int fd, const std::vector<Sort_Key>& order, int limit = -1) const;
+    void print_sorted(Output_Writer& writer, const std::vector<Sort_Key>& order, int limit = -1) const;
 
     void clear();
     void set_column_names(const std::vector<std::string>& names);
+    const std::vector<std::string>& get_column_names() const { return column_names; }
+
+    // Counters for the installed selection, node by node, and for
+    // print_selection.  They accumulate from when the selection was built
+    // (print counters from when the sheet was created) until reset_profile.
+    Query_Profile profile() const;
+    void reset_profile();
+
+    // Whether lazy selections count every row they are asked about; off by
+    // default, since those counts cost an atomic update per row.  Eager
+    // selections and print_selection always count.
+    void set_profiling(bool on);
+    bool get_profiling() const { return profiling; }
     void add_row(const std::vector<std::string>& row_data);
+    void add_row(std::vector<std::string>&& row_data);
+    void add_row(const Cell_View* row_cells, int count);
+
+    // Build a row in place from its cells, e.g. emplace_row("Jane", "Cat").
+    template<class... Cells>
+    void emplace_row(const Cells&... values)
+    {
+        const Cell_View row[] = {as_view(values)...};
+        add_row(row, sizeof...(Cells));
+    }
+
+    // Append every row in [first, last).
+    template<class Iterator>
+    void add_rows(Iterator first, Iterator last)
+    {
+        reserve_for(first, last, typename std::iterator_traits<Iterator>::iterator_category());
+        for(; first != last; ++first)
+            add_row(*first);
+    }
+
+    void add_rows(std::vector<std::vector<std::string> >&& new_rows)
+    {
+        add_rows(std::make_move_iterator(new_rows.begin()), std::make_move_iterator(new_rows.end()));
+        new_rows.clear();
+    }
+
+    // Make room for this many rows in total, so appending up to that point
+    // does not reallocate the cell (or per-column offset) tables.
+    void reserve(int total_rows);
+
+    // Replace the contents of the sheet with a delimited text file (CSV with
+    // ',' or TSV with '\t').  The first record supplies the column names.
+    // Fields may be quoted with '"', with "" standing for a literal quote.
+    // The file is memory-mapped and parsed in place; files without quotes
+    // are split at line boundaries and parsed on the thread pool.  Throws
+    // std::system_error if the file cannot be read.
+    void load_delimited(const std::string& path, char delimiter = ',');
     int get_column_by_name(const std::string& name) const;
+    Column_Handle resolve_column(const std::string& name) const;
+
+    // Like get_column_by_name, but throws std::out_of_range for a name that
+    // is not a column.
+    int require_column(const std::string& name) const;
+    std::vector<int> require_columns(const std::vector<std::string>& names) const;
+
+    // Replace key with the cells of row in columns, each prefixed with its
+    // length so that different splits of the same bytes stay apart.  Rows
+    // whose cells match have equal keys, which group_by and Hash_Join hash.
+    void row_key(int row, const std::vector<int>& columns, std::string& key) const;
+
+    // The index a handle refers to; throws std::logic_error if the column
+    // names have changed since it was resolved.
+    int checked(Column_Handle column) const;
     int get_row_size() const{
-	return data.size();
+	return rows;
 	}
+
+    // Convert the existing rows to the requested layout.  Later rows are
+    // added in the same layout.
+    void set_storage(Storage new_storage);
+    Storage get_storage() const { return storage; }
+
+    // Store a COLUMN_MAJOR column as a table of its distinct values plus an
+    // integer code per row (or back as plain cells).  Worth it for columns
+    // with few distinct values.  Throws std::logic_error on a ROW_MAJOR
+    // sheet.
+    void set_dictionary_encoded(Column_Handle column, bool encoded = true);
+
+    // Keep a trigram index on a column so that Select_Contains with a
+    // needle of three or more bytes only checks candidate rows.  The index
+    // follows add_row and writes through cell_data; clear() drops it.
+    void set_ngram_index(Column_Handle column, bool enabled = true);
+
+    const Ngram_Index* ngram_index(int column) const
+    {
+        if(column < 0 || column >= ngram_indexes.size())
+            return nullptr;
+        return ngram_indexes[column].get();
+    }
+
+    // Keep a Zone_Map on a column so that eager Select_Contains scans skip
+    // blocks of Zone_Map::block_rows rows that cannot hold the needle.  The
+    // map follows add_row and writes through cell_data; clear() drops it.
+    void set_zone_map(Column_Handle column, bool enabled = true);
+
+    const Zone_Map* zone_map(int column) const
+    {
+        if(column < 0 || column >= zone_maps.size())
+            return nullptr;
+        return zone_maps[column].get();
+    }
+
+    // Declare a column INT64, DOUBLE or DATE: its cells are parsed into a
+    // packed array of native values that Select_Compare and Select_Between
+    // scan.  The text is kept for printing.  The values follow add_row and
+    // writes through cell_data; TEXT drops them, as does clear().
+    void set_column_type(Column_Handle column, Typed_Column::Type type);
+
+    // The parsed values of a typed column, or nullptr for a TEXT column.
+    const Typed_Column* typed_column(int column) const
+    {
+        if(column < 0 || column >= typed_columns.size())
+            return nullptr;
+        return typed_columns[column].get();
+    }
+
+    // The storage behind a column of a COLUMN_MAJOR sheet, or nullptr.
+    const Column* column_store(int column) const
+    {
+        if(storage != COLUMN_MAJOR || column < 0 || column >= columns.size())
+            return nullptr;
+        return &columns[column];
+    }
+
+    // Applies to selections constructed after the call.
+    void set_evaluation(Evaluation mode) { evaluation = mode; }
+    Evaluation get_evaluation() const { return evaluation; }
+
+    // Number of threads used by column scans and print_selection, counting
+    // the calling thread.  1 (the default) runs everything on the caller.
+    void set_thread_count(int threads);
+    int get_thread_count() const;
+    Thread_Pool* thread_pool() const { return pool.get(); }
+
+    // Bumped by every change to the rows, cells or column names.
+    unsigned long get_version() const { return version; }
+
+    // Keep up to this many selection results, keyed by the fingerprint of
+    // the predicate subtree that produced them, so identical subtrees are
+    // only evaluated once per sheet version, within one query or across
+    // queries.  0 (the default) turns the cache off.  The cache is not
+    // locked; build selections on one thread at a time.
+    void set_result_cache_size(int entries) { cache.set_capacity(entries); }
+    bool result_cache_enabled() const { return cache.enabled(); }
+
+    // The cached rows for a fingerprint, or nullptr.  The pointer is only
+    // good until the next cache call.
+    const Row_Bitmap* cached_result(const std::string& fingerprint) const
+    {
+        return cache.find(fingerprint, version);
+    }
+
+    void cache_result(const std::string& fingerprint, const Row_Bitmap& rows) const
+    {
+        cache.insert(fingerprint, rows, version);
+    }
+
+    // Rows per unit of parallel work; a multiple of 64 so that chunks of a
+    // Row_Bitmap never share a word.
+    static const int parallel_grain = 16384;
 };
 
+inline Cell_View Cell_Ref::view() const
+{
+    return static_cast<const Spreadsheet*>(sheet)->cell_data(row, column);
+}
+
 #endif //__SPREADSHEET_HPP__
@@ -0,0 +1,176 @@
+#include "spreadsheet.hpp"
+#include "select.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+
+// Running totals of the groups seen in one slice of rows.  Groups are
+// numbered in the order they are met; the totals of group g for aggregate a
+// are totals[g * aggregates + a], so adding a group allocates nothing per
+// aggregate.
+struct Group_Table
+{
+    struct Totals
+    {
+        double sum;
+        double min;
+        double max;
+        uint64_t values;
+    };
+
+    int aggregates;
+    std::unordered_map<std::string, int> index;
+    std::vector<int> first_row;
+    std::vector<uint64_t> rows;
+    std::vector<Totals> totals;
+
+    explicit Group_Table(int aggregates) : aggregates(aggregates) {}
+
+    int size() const { return first_row.size(); }
+
+    // The number of key's group, added with first row row if it is new.
+    int find(const std::string& key, int row)
+    {
+        std::unordered_map<std::string, int>::const_iterator it = index.find(key);
+        if(it != index.end())
+            return it->second;
+        int group = size();
+        index.insert(std::make_pair(key, group));
+        first_row.push_back(row);
+        rows.push_back(0);
+        Totals empty = {0.0, std::numeric_limits<double>::infinity(),
+                        -std::numeric_limits<double>::infinity(), 0};
+        totals.insert(totals.end(), aggregates, empty);
+        return group;
+    }
+
+    void add(int group, int a, double value)
+    {
+        Totals& t = totals[std::size_t(group) * aggregates + a];
+        t.sum += value;
+        t.min = std::min(t.min, value);
+        t.max = std::max(t.max, value);
+        t.values++;
+    }
+
+    void merge(const Group_Table& other)
+    {
+        for(std::unordered_map<std::string, int>::const_iterator it = other.index.begin();
+            it != other.index.end(); ++it)
+        {
+            int from = it->second;
+            int to = find(it->first, other.first_row[from]);
+            first_row[to] = std::min(first_row[to], other.first_row[from]);
+            rows[to] += other.rows[from];
+            for(int a = 0; a < aggregates; a++)
+            {
+                Totals& t = totals[std::size_t(to) * aggregates + a];
+                const Totals& o = other.totals[std::size_t(from) * aggregates + a];
+                t.sum += o.sum;
+                t.min = std::min(t.min, o.min);
+                t.max = std::max(t.max, o.max);
+                t.values += o.values;
+            }
+        }
+    }
+};
+
+}
+
+std::vector<Group_Row> Spreadsheet::group_by(const std::vector<std::string>& keys,
+                                             const std::vector<Aggregate>& aggregates) const
+{
+    std::vector<int> key_columns = require_columns(keys);
+    std::vector<int> value_columns(aggregates.size(), -1);
+    for(int a = 0; a < aggregates.size(); a++)
+        if(aggregates[a].function != Aggregate::COUNT)
+            value_columns[a] = require_column(aggregates[a].column);
+
+    // Fill the table of one slice of rows.
+    auto fill = [&](int first, int last, Group_Table& table) {
+        std::string key;
+        for(int i = first; i < last; i++)
+        {
+            if(select && !select->select(i))
+                continue;
+            row_key(i, key_columns, key);
+            int group = table.find(key, i);
+            table.rows[group]++;
+
+            for(int a = 0; a < aggregates.size(); a++)
+            {
+                int column = value_columns[a];
+                if(column == -1)
+                    continue;
+                if(const Typed_Column* typed = typed_column(column))
+                {
+                    if(!typed->present().test(i))
+                        continue;
+                    table.add(group, a, typed->type() == Typed_Column::DOUBLE ? typed->real_data()[i]
+                                                                               : double(typed->int_data()[i]));
+                }
+                else
+                {
+                    double value;
+                    if(Typed_Column::parse_double(cell_data(i, column), value))
+                        table.add(group, a, value);
+                }
+            }
+        }
+    };
+
+    // One table per thread's slice of the rows rather than per chunk, so
+    // the tables to build and merge stay few however long the sheet is.
+    Group_Table merged(aggregates.size());
+    if(pool && rows > parallel_grain)
+    {
+        int slices = pool->size();
+        int grain = (rows + slices - 1) / slices;
+        std::vector<Group_Table> tables(slices, Group_Table(aggregates.size()));
+        pool->parallel_for(0, rows, grain, [&](int first, int last) {
+            fill(first, last, tables[first / grain]);
+        });
+        std::swap(merged, tables[0]);
+        for(int t = 1; t < slices; t++)
+            merged.merge(tables[t]);
+    }
+    else
+        fill(0, rows, merged);
+
+    std::vector<int> groups(merged.size());
+    for(int g = 0; g < groups.size(); g++)
+        groups[g] = g;
+    std::sort(groups.begin(), groups.end(), [&](int a, int b) {
+        return merged.first_row[a] < merged.first_row[b];
+    });
+
+    std::vector<Group_Row> result(groups.size());
+    for(int g = 0; g < groups.size(); g++)
+    {
+        int group = groups[g];
+        Group_Row& row = result[g];
+        for(int k = 0; k < key_columns.size(); k++)
+            row.keys.push_back(cell_data(merged.first_row[group], key_columns[k]).str());
+        for(int a = 0; a < aggregates.size(); a++)
+        {
+            const Group_Table::Totals& t = merged.totals[std::size_t(group) * aggregates.size() + a];
+            bool any = t.values > 0;
+            double nan = std::numeric_limits<double>::quiet_NaN();
+            switch(aggregates[a].function)
+            {
+            case Aggregate::COUNT: row.values.push_back(merged.rows[group]); break;
+            case Aggregate::SUM: row.values.push_back(t.sum); break;
+            case Aggregate::MIN: row.values.push_back(any ? t.min : nan); break;
+            case Aggregate::MAX: row.values.push_back(any ? t.max : nan); break;
+            case Aggregate::AVG: row.values.push_back(any ? t.sum / t.values : nan); break;
+            }
+        }
+    }
+    return result;
+}
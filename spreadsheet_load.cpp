@@ -0,0 +1,233 @@
+#include "spreadsheet.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class Mapped_File
+{
+    const char* bytes = nullptr;
+    std::size_t length = 0;
+
+    static void fail(const std::string& path)
+    {
+        throw std::system_error(errno, std::generic_category(), "load_delimited: cannot read " + path);
+    }
+
+public:
+    explicit Mapped_File(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            fail(path);
+        struct stat info;
+        if(::fstat(fd, &info) < 0)
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            fail(path);
+        }
+        length = info.st_size;
+        if(length > 0)
+        {
+            void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED)
+            {
+                int error = errno;
+                ::close(fd);
+                errno = error;
+                fail(path);
+            }
+            ::madvise(p, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(p);
+        }
+        ::close(fd);
+    }
+
+    ~Mapped_File()
+    {
+        if(bytes)
+            ::munmap(const_cast<char*>(bytes), length);
+    }
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator=(const Mapped_File&) = delete;
+
+    const char* begin() const { return bytes; }
+    const char* end() const { return bytes + length; }
+};
+
+// The records parsed from one stretch of the file: every field back to back,
+// plus the number of fields in each record.  Fields point into the mapping,
+// except quoted fields containing "" which point into unescaped.
+struct Records
+{
+    std::vector<Cell_View> fields;
+    std::vector<int> widths;
+    std::deque<std::string> unescaped;
+};
+
+// Parse the record starting at p and return the position after its line end.
+const char* parse_record(const char* p, const char* end, char delimiter, Records& out)
+{
+    int width = 0;
+    for(;;)
+    {
+        if(p < end && *p == '"')
+        {
+            // A quoted field runs to the closing quote and may contain
+            // delimiters and newlines.  Only fields with "" are copied.
+            const char* start = ++p;
+            std::string* copy = nullptr;
+            Cell_View field;
+            for(;;)
+            {
+                const char* q = static_cast<const char*>(std::memchr(p, '"', end - p));
+                if(!q)
+                    q = end;
+                if(q + 1 < end && q[1] == '"')
+                {
+                    if(!copy)
+                    {
+                        out.unescaped.push_back(std::string());
+                        copy = &out.unescaped.back();
+                    }
+                    copy->append(p, q - p + 1);
+                    p = q + 2;
+                    continue;
+                }
+                if(copy)
+                {
+                    copy->append(p, q - p);
+                    field = Cell_View(*copy);
+                }
+                else
+                    field = Cell_View(start, q - start);
+                p = q < end ? q + 1 : end;
+                break;
+            }
+            out.fields.push_back(field);
+            while(p < end && *p != delimiter && *p != '\n')
+                p++;
+        }
+        else
+        {
+            const char* start = p;
+            while(p < end && *p != delimiter && *p != '\n')
+                p++;
+            const char* stop = p;
+            if(stop > start && stop[-1] == '\r' && (p == end || *p == '\n'))
+                stop--;
+            out.fields.push_back(Cell_View(start, stop - start));
+        }
+        width++;
+
+        if(p < end && *p == delimiter)
+        {
+            p++;
+            continue;
+        }
+        if(p < end)
+            p++;
+        break;
+    }
+    out.widths.push_back(width);
+    return p;
+}
+
+const char* skip_blank_lines(const char* p, const char* end)
+{
+    while(p < end)
+    {
+        if(*p == '\n')
+            p++;
+        else if(*p == '\r' && p + 1 < end && p[1] == '\n')
+            p += 2;
+        else
+            break;
+    }
+    return p;
+}
+
+void parse_records(const char* p, const char* end, char delimiter, Records& out)
+{
+    for(p = skip_blank_lines(p, end); p < end; p = skip_blank_lines(p, end))
+        p = parse_record(p, end, delimiter, out);
+}
+
+// First position after the newline at or after p.
+const char* next_line(const char* p, const char* end)
+{
+    const char* q = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return q ? q + 1 : end;
+}
+
+}
+
+void Spreadsheet::load_delimited(const std::string& path, char delimiter)
+{
+    Mapped_File file(path);
+    const char* p = skip_blank_lines(file.begin(), file.end());
+    const char* end = file.end();
+
+    clear();
+    if(p == end)
+        return;
+
+    Records header;
+    p = parse_record(p, end, delimiter, header);
+    std::vector<std::string> names;
+    names.reserve(header.fields.size());
+    for(int j = 0; j < header.fields.size(); j++)
+        names.push_back(header.fields[j].str());
+    set_column_names(names);
+
+    // Without quotes every newline ends a record, so the body can be cut at
+    // arbitrary line boundaries and each piece parsed independently.
+    const std::size_t parallel_bytes = 1 << 20;
+    int pieces = 1;
+    if(pool && end - p > parallel_bytes && !std::memchr(p, '"', end - p))
+        pieces = pool->size() * 2;
+
+    std::vector<const char*> cuts(pieces + 1, end);
+    cuts[0] = p;
+    for(int k = 1; k < pieces; k++)
+        cuts[k] = std::max(cuts[k - 1], next_line(p + (end - p) / pieces * k, end));
+
+    std::vector<Records> parts(pieces);
+    if(pieces > 1)
+        pool->parallel_for(0, pieces, 1, [&](int first, int last) {
+            for(int k = first; k < last; k++)
+                parse_records(cuts[k], cuts[k + 1], delimiter, parts[k]);
+        });
+    else
+        parse_records(cuts[0], cuts[1], delimiter, parts[0]);
+
+    std::size_t total = 0;
+    for(int k = 0; k < pieces; k++)
+        total += parts[k].widths.size();
+    reserve(rows + total);
+
+    for(int k = 0; k < pieces; k++)
+    {
+        const Records& part = parts[k];
+        const Cell_View* fields = part.fields.data();
+        for(int r = 0; r < part.widths.size(); r++)
+        {
+            add_row(fields, part.widths[r]);
+            fields += part.widths[r];
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#include "spreadsheet.hpp"
+#include "select.hpp"
+#include "selection_range.hpp"
+#include "output_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// Strict weak ordering of rows by a list of sort keys, with the row index as
+// the final tie-break so that equal rows keep their order.
+class Row_Order
+{
+    struct Key
+    {
+        int column;
+        const Typed_Column* typed;
+        bool descending;
+    };
+
+    const Spreadsheet* sheet;
+    std::vector<Key> keys;
+
+    static int compare_bytes(Cell_View a, Cell_View b)
+    {
+        int c = std::memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+        if(c)
+            return c;
+        return a.size() < b.size() ? -1 : a.size() > b.size();
+    }
+
+    template<class T>
+    static int compare_values(T a, T b)
+    {
+        return a < b ? -1 : b < a;
+    }
+
+public:
+    Row_Order(const Spreadsheet* sheet, const std::vector<Sort_Key>& order)
+        : sheet(sheet)
+    {
+        for(int k = 0; k < order.size(); k++)
+        {
+            int column = sheet->require_column(order[k].column);
+            Key key = {column, sheet->typed_column(column), order[k].descending};
+            keys.push_back(key);
+        }
+    }
+
+    // Whether row a sorts before row b.
+    bool operator()(int a, int b) const
+    {
+        for(int k = 0; k < keys.size(); k++)
+        {
+            const Key& key = keys[k];
+            int c;
+            if(key.typed)
+            {
+                bool has_a = key.typed->present().test(a), has_b = key.typed->present().test(b);
+                if(has_a != has_b)
+                    return has_a;
+                if(!has_a)
+                    continue;
+                if(key.typed->type() == Typed_Column::DOUBLE)
+                    c = compare_values(key.typed->real_data()[a], key.typed->real_data()[b]);
+                else
+                    c = compare_values(key.typed->int_data()[a], key.typed->int_data()[b]);
+            }
+            else
+                c = compare_bytes(sheet->cell_data(a, key.column), sheet->cell_data(b, key.column));
+            if(c)
+                return key.descending ? c > 0 : c < 0;
+        }
+        return a < b;
+    }
+};
+
+}
+
+std::vector<int> Spreadsheet::sorted_rows(const std::vector<Sort_Key>& order, int limit) const
+{
+    Row_Order before(this, order);
+    std::vector<int> result;
+    if(limit < 0)
+    {
+        for(Row_View row : selected_rows())
+            result.push_back(row.index());
+        std::sort(result.begin(), result.end(), before);
+        return result;
+    }
+    if(limit == 0)
+        return result;
+
+    // Keep the best limit rows seen so far in a heap whose top is the worst
+    // of them; a new row only gets in by displacing it.
+    result.reserve(limit);
+    for(Row_View row : selected_rows())
+    {
+        int i = row.index();
+        if(result.size() < limit)
+        {
+            result.push_back(i);
+            std::push_heap(result.begin(), result.end(), before);
+        }
+        else if(before(i, result.front()))
+        {
+            std::pop_heap(result.begin(), result.end(), before);
+            result.back() = i;
+            std::push_heap(result.begin(), result.end(), before);
+        }
+    }
+    std::sort_heap(result.begin(), result.end(), before);
+    return result;
+}
+
+void Spreadsheet::print_sorted(std::ostream& out, const std::vector<Sort_Key>& order, int limit) const
+{
+    Output_Writer writer(out);
+    print_sorted(writer, order, limit);
+}
+
+void Spreadsheet::print_sorted(int fd, const std::vector<Sort_Key>& order, int limit) const
+{
+    Output_Writer writer(fd);
+    print_sorted(writer, order, limit);
+}
+
+void Spreadsheet::print_sorted(Output_Writer& writer, const std::vector<Sort_Key>& order, int limit) const
+{
+    Scoped_Timer timer(print_counters.nanoseconds);
+    std::vector<int> rows = sorted_rows(order, limit);
+    std::vector<int> fields(column_names.size());
+    for(int j = 0; j < fields.size(); j++)
+        fields[j] = j;
+
+    uint64_t written = 0;
+    for(int k = 0; k < rows.size(); k++)
+    {
+        std::size_t before = writer.data().size();
+        format_row(rows[k], fields, writer.data());
+        written += writer.data().size() - before;
+        writer.maybe_flush();
+    }
+    print_counters.rows_emitted.fetch_add(rows.size(), std::memory_order_relaxed);
+    print_counters.bytes_written.fetch_add(written, std::memory_order_relaxed);
+    writer.flush();
+}
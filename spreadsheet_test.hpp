@@ -2,9 +2,16 @@
 #define __SPREADSHEET_TEST__
 #include "spreadsheet.hpp"
 #include "select.hpp"
+#include "query.hpp"
+#include "selection_range.hpp"
+#include "hash_join.hpp"
 
+#include <algorithm>
 #include <string>
 #include <sstream>
+#include <cstdio>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -586,6 +593,1054 @@ TEST(CompositeSelectTest, select_And_Or_Not)
 }
 
 
+TEST(ColumnarTest, select_sameResultAsRowMajor)
+{
+	Spreadsheet sheet;
+	sheet.set_storage(Spreadsheet::COLUMN_MAJOR);
+	sheet.set_column_names({"Name", "FavFood"});
+	sheet.add_row({"Adam Smith", "apple"});
+	sheet.add_row({"Jane Smith", "apples"});
+	sheet.add_row({"Zelda Hyrule", "fruitcake"});
+
+	sheet.set_selection(
+		new Select_And(
+			new Select_Contains(&sheet,"FavFood","apple"),
+			new Select_Not(
+				new Select_Contains(&sheet,"Name","Adam"))));
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	std::string test = ss.str();
+	EXPECT_EQ(test, "Jane Smith apples\n");
+}
+
+TEST(ColumnarTest, convertAndWriteCells)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Name", "Pet"});
+	sheet.add_row({"Jane","Cat"});
+	sheet.add_row({"John","Dog"});
+
+	sheet.set_storage(Spreadsheet::COLUMN_MAJOR);
+	sheet.cell_data(0, 1) = "Hamster";
+	sheet.cell_data(1, 1) = "Ox";
+	EXPECT_EQ(sheet.cell_data(0, 1), "Hamster");
+	EXPECT_THROW(sheet.cell_data(2, 0).str(), std::out_of_range);
+
+	sheet.set_storage(Spreadsheet::ROW_MAJOR);
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	std::string test = ss.str();
+	EXPECT_EQ(test, "Jane Hamster\nJohn Ox\n");
+}
+
+
+TEST(BitmapSelectTest, select_acrossWordBoundary)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Id"});
+	for(int i = 0; i < 130; i++)
+		sheet.add_row({std::to_string(i)});
+
+	sheet.set_selection(
+		new Select_Or(
+			new Select_Contains(&sheet,"Id","64"),
+			new Select_Not(
+				new Select_Contains(&sheet,"Id","1"))));
+
+	Row_Bitmap expected(130);
+	for(int i = 0; i < 130; i++)
+		if(i == 64 || std::to_string(i).find("1") == std::string::npos)
+			expected.set(i);
+
+	std::stringstream ss, ref;
+	sheet.print_selection(ss);
+	for(int i = 0; i < 130; i++)
+		if(expected.test(i))
+			ref << i << "\n";
+	EXPECT_EQ(ss.str(), ref.str());
+	EXPECT_EQ(expected.count(), 81);
+}
+
+TEST(BitmapSelectTest, combine_childrenOfDifferentLengths)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Id"});
+	for(int i = 0; i < 64; i++)
+		sheet.add_row({"x"});
+	Select* shorter = new Select_Contains(&sheet,"Id","x");
+	for(int i = 0; i < 6; i++)
+		sheet.add_row({"x"});
+
+	Select_Or either(shorter, new Select_Contains(&sheet,"Id","x"));
+	ASSERT_NE(either.bitmap(), nullptr);
+	EXPECT_EQ(either.bitmap()->size(), 70);
+	EXPECT_EQ(either.bitmap()->count(), 70);
+
+	Select_And both(new Select_Contains(&sheet,"Id","x"), new Select_Contains(&sheet,"Id","x"));
+	EXPECT_EQ(both.bitmap()->size(), 70);
+	EXPECT_EQ(both.bitmap()->count(), 70);
+
+	Select* stale = new Select_Contains(&sheet,"Id","x");
+	sheet.add_row({"x"});
+	Select_And tail(stale, new Select_Contains(&sheet,"Id","x"));
+	EXPECT_EQ(tail.bitmap()->size(), 71);
+	EXPECT_EQ(tail.bitmap()->count(), 71);
+	EXPECT_TRUE(tail.select(70));
+}
+
+
+TEST(LazySelectTest, select_sameResultAsEager)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	sheet.add_row({"apple"});
+	sheet.add_row({"apples"});
+	sheet.add_row({"Snapple"});
+	sheet.add_row({"Apple"});
+	sheet.set_evaluation(Spreadsheet::LAZY);
+
+	Select* query =
+			new Select_And(
+				new Select_Contains(&sheet,"Food","apple"),
+				new Select_Or(
+					new Select_Contains(&sheet,"Food","s"),
+					new Select_Not(
+						new Select_Contains(&sheet,"Food","S"))));
+	EXPECT_EQ(query->bitmap(), nullptr);
+	sheet.set_selection(query);
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	std::string test = ss.str();
+	EXPECT_EQ(test, "apple\napples\n");
+}
+
+TEST(LazySelectTest, select_mixedWithEagerChild)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Name", "Pet"});
+	sheet.add_row({"Jane","Cat"});
+	sheet.add_row({"John","Dog"});
+	sheet.add_row({"Jake","Dog"});
+
+	Select* eager = new Select_Contains(&sheet,"Pet","Dog");
+	sheet.set_evaluation(Spreadsheet::LAZY);
+	sheet.set_selection(
+		new Select_And(
+			eager,
+			new Select_Contains(&sheet,"Name","k")));
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	std::string test = ss.str();
+	EXPECT_EQ(test, "Jake Dog\n");
+}
+
+
+TEST(ParallelTest, select_sameOutputAsSerial)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Id", "Parity"});
+	for(int i = 0; i < 50000; i++)
+		sheet.add_row({std::to_string(i), i % 2 ? "odd" : "even"});
+
+	std::stringstream serial;
+	sheet.set_selection(
+		new Select_And(
+			new Select_Contains(&sheet,"Id","7"),
+			new Select_Contains(&sheet,"Parity","odd")));
+	sheet.print_selection(serial);
+
+	sheet.set_thread_count(4);
+	EXPECT_EQ(sheet.get_thread_count(), 4);
+	std::stringstream parallel;
+	sheet.set_selection(
+		new Select_And(
+			new Select_Contains(&sheet,"Id","7"),
+			new Select_Contains(&sheet,"Parity","odd")));
+	sheet.print_selection(parallel);
+
+	EXPECT_FALSE(serial.str().empty());
+	EXPECT_EQ(parallel.str(), serial.str());
+}
+
+TEST(ParallelTest, print_exceptionReachesCaller)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Id", "Parity"});
+	for(int i = 0; i < 40001; i++)
+		if(i == 30000)
+			sheet.add_row({std::to_string(i)});
+		else
+			sheet.add_row({std::to_string(i), i % 2 ? "odd" : "even"});
+	sheet.set_thread_count(4);
+
+	std::stringstream first, second;
+	EXPECT_THROW(sheet.print_selection(first), std::out_of_range);
+	EXPECT_THROW(sheet.print_selection(second), std::out_of_range);
+
+	EXPECT_THROW(sheet.set_selection(new Select_Contains(&sheet,"Parity","odd")), std::out_of_range);
+	std::stringstream ids;
+	sheet.set_selection(new Select_Contains(&sheet,"Id","1"));
+	sheet.print_selection(ids, std::vector<std::string>{"Id"});
+	EXPECT_EQ(ids.str().substr(0, 8), "1\n10\n11\n");
+}
+
+
+TEST(SubstringMatcherTest, findMatchesStdString)
+{
+	unsigned seed = 12345;
+	auto next = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7fff; };
+	for(int trial = 0; trial < 2000; trial++){
+		std::string text, needle;
+		int length = next() % 100;
+		for(int i = 0; i < length; i++)
+			text += "abc"[next() % 3];
+		int needle_length = next() % 6;
+		for(int i = 0; i < needle_length; i++)
+			needle += "abc"[next() % 3];
+
+		Substring_Matcher matcher(needle);
+		EXPECT_EQ(matcher.find(text.data(), text.size()), text.find(needle))
+			<< "text=" << text << " needle=" << needle << " kernel=" << matcher.kernel_name();
+	}
+}
+
+
+TEST(OutputWriterTest, print_fdMatchesStream)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Name", "Pet"});
+	for(int i = 0; i < 3000; i++)
+		sheet.add_row({"Name" + std::to_string(i), i % 3 ? "Cat" : "Dog"});
+	sheet.set_selection(new Select_Contains(&sheet,"Pet","Dog"));
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+
+	FILE* file = tmpfile();
+	ASSERT_NE(file, nullptr);
+	sheet.print_selection(fileno(file));
+	std::string written(ftell(file), '\0');
+	rewind(file);
+	ASSERT_EQ(fread(&written[0], 1, written.size(), file), written.size());
+	fclose(file);
+
+	EXPECT_EQ(written, ss.str());
+	EXPECT_EQ(ss.str().substr(0, 20), "Name0 Dog\nName3 Dog\n");
+}
+
+
+TEST(ColumnHandleTest, resolveOnceAndReuse)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food", "Drink", "Food"});
+	sheet.add_row({"apple", "tea", "pie"});
+	sheet.add_row({"salad", "apple juice", "soup"});
+
+	EXPECT_EQ(sheet.get_column_by_name("Food"), 0);
+	EXPECT_EQ(sheet.get_column_by_name("Drink"), 1);
+	EXPECT_EQ(sheet.get_column_by_name("Dessert"), -1);
+
+	Column_Handle drink = sheet.resolve_column("Drink");
+	EXPECT_TRUE(drink.valid());
+	EXPECT_EQ(sheet.cell_data(1, drink), "apple juice");
+	EXPECT_FALSE(sheet.resolve_column("Dessert").valid());
+
+	sheet.set_selection(new Select_Contains(&sheet, drink, "apple"));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "salad apple juice soup\n");
+
+	sheet.set_column_names({"Drink"});
+	EXPECT_THROW(sheet.cell_data(0, drink), std::logic_error);
+}
+
+
+TEST(LoadTest, load_csvWithQuotes)
+{
+	char path[] = "/tmp/spreadsheet_testXXXXXX";
+	int fd = mkstemp(path);
+	ASSERT_NE(fd, -1);
+	std::string csv = "First,Last,Major\r\n"
+		"Amanda,Andrews,business\r\n"
+		"\r\n"
+		"\"Brian \"\"B\"\"\",Becker,\"computer, science\"\n"
+		"Carol,,math";
+	ASSERT_EQ(write(fd, csv.data(), csv.size()), (ssize_t)csv.size());
+	close(fd);
+
+	Spreadsheet sheet;
+	sheet.load_delimited(path);
+	unlink(path);
+
+	EXPECT_EQ(sheet.get_row_size(), 3);
+	EXPECT_EQ(sheet.get_column_by_name("Major"), 2);
+	EXPECT_EQ(sheet.cell_data(1, 0), "Brian \"B\"");
+	EXPECT_EQ(sheet.cell_data(1, 2), "computer, science");
+	EXPECT_EQ(sheet.cell_data(2, 1), "");
+
+	sheet.set_selection(new Select_Contains(&sheet,"Major","s"));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "Amanda Andrews business\nBrian \"B\" Becker computer, science\n");
+}
+
+TEST(LoadTest, load_parallelTsvMatchesSerial)
+{
+	char path[] = "/tmp/spreadsheet_testXXXXXX";
+	int fd = mkstemp(path);
+	ASSERT_NE(fd, -1);
+	std::string tsv = "Id\tName\n";
+	for(int i = 0; i < 100000; i++)
+		tsv += std::to_string(i) + "\tname" + std::to_string(i * 7) + "\n";
+	ASSERT_EQ(write(fd, tsv.data(), tsv.size()), (ssize_t)tsv.size());
+	close(fd);
+
+	Spreadsheet serial, parallel;
+	serial.load_delimited(path, '\t');
+	parallel.set_thread_count(4);
+	parallel.set_storage(Spreadsheet::COLUMN_MAJOR);
+	parallel.load_delimited(path, '\t');
+	unlink(path);
+
+	std::stringstream a, b;
+	serial.print_selection(a);
+	parallel.print_selection(b);
+	EXPECT_EQ(parallel.get_row_size(), 100000);
+	EXPECT_EQ(parallel.cell_data(99999, 1), "name699993");
+	EXPECT_EQ(a.str(), b.str());
+}
+
+
+TEST(IngestTest, moveEmplaceAndBatchRows)
+{
+	for(int storage = 0; storage < 2; storage++){
+		Spreadsheet sheet;
+		sheet.set_storage(storage ? Spreadsheet::COLUMN_MAJOR : Spreadsheet::ROW_MAJOR);
+		sheet.set_column_names({"Name", "Pet"});
+		sheet.reserve(5);
+
+		std::vector<std::string> row = {"Jane", "Cat"};
+		sheet.add_row(std::move(row));
+		std::string pet = "Dog";
+		sheet.emplace_row("John", pet);
+
+		std::vector<std::vector<std::string> > batch = {{"Jake", "Fish"}, {"Jill", "Dog"}};
+		sheet.add_rows(batch.begin(), batch.end());
+		EXPECT_EQ(batch[0][0], "Jake");
+		sheet.add_rows(std::move(batch));
+		EXPECT_TRUE(batch.empty());
+
+		EXPECT_EQ(sheet.get_row_size(), 6);
+		sheet.set_selection(new Select_Contains(&sheet,"Pet","Dog"));
+		std::stringstream ss;
+		sheet.print_selection(ss);
+		EXPECT_EQ(ss.str(), "John Dog\nJill Dog\nJill Dog\n");
+	}
+}
+
+
+TEST(ArenaTest, clearReuseAndOverwrite)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Name", "Pet"});
+	for(int i = 0; i < 1000; i++)
+		sheet.add_row({"Name" + std::to_string(i), std::string(i % 50, 'x')});
+	sheet.clear();
+	EXPECT_EQ(sheet.get_row_size(), 0);
+
+	sheet.set_column_names({"Name", "Pet"});
+	sheet.add_row({"Jane", "Cat"});
+	sheet.add_row({"John"});
+	sheet.cell_data(0, 1) = "Hippopotamus";
+	EXPECT_EQ(sheet.cell_data(0, 1), "Hippopotamus");
+	EXPECT_EQ(sheet.cell_data(1, 0), "John");
+	EXPECT_THROW(sheet.cell_data(1, 1).str(), std::out_of_range);
+
+	Cell_Arena arena;
+	const char* a = arena.store("abc", 3);
+	arena.reset();
+	EXPECT_EQ(arena.store("xyz", 3), a);
+	EXPECT_EQ(std::string(a, 3), "xyz");
+}
+
+
+TEST(DictionaryTest, select_encodedColumn)
+{
+	Spreadsheet sheet;
+	sheet.set_storage(Spreadsheet::COLUMN_MAJOR);
+	sheet.set_column_names({"First", "Major"});
+	sheet.add_row({"Brian", "computer science"});
+	sheet.add_row({"Joe", "mathematics"});
+	sheet.add_row({"Diane", "computer engineering"});
+	sheet.set_dictionary_encoded(sheet.resolve_column("Major"));
+	sheet.add_row({"Sarah", "computer science"});
+	sheet.add_row({"George", "astrophysics"});
+
+	const Column* major = sheet.column_store(1);
+	ASSERT_NE(major, nullptr);
+	EXPECT_TRUE(major->encoded());
+	EXPECT_EQ(major->distinct(), 4);
+
+	sheet.cell_data(1, 1) = "business";
+	sheet.set_selection(new Select_Contains(&sheet,"Major","s"));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "Brian computer science\nJoe business\nSarah computer science\nGeorge astrophysics\n");
+
+	sheet.set_evaluation(Spreadsheet::LAZY);
+	sheet.set_selection(new Select_Contains(&sheet,"Major","engineering"));
+	sheet.add_row({"David", "electrical engineering"});
+	std::stringstream lazy;
+	sheet.print_selection(lazy);
+	EXPECT_EQ(lazy.str(), "Diane computer engineering\nDavid electrical engineering\n");
+
+	Spreadsheet rows;
+	rows.set_column_names({"Major"});
+	EXPECT_THROW(rows.set_dictionary_encoded(rows.resolve_column("Major")), std::logic_error);
+}
+
+TEST(DictionaryTest, extend_newValuesUnderEagerSelection)
+{
+	Spreadsheet sheet;
+	sheet.set_storage(Spreadsheet::COLUMN_MAJOR);
+	sheet.set_column_names({"A"});
+	sheet.add_row({"x"});
+	sheet.add_row({"y"});
+	sheet.set_dictionary_encoded(sheet.resolve_column("A"));
+	sheet.set_selection(new Select_Contains(&sheet,"A","y"));
+	for(int i = 0; i < 200; i++)
+		sheet.add_row({"y" + std::to_string(i)});
+
+	std::stringstream ss, expected;
+	sheet.print_selection(ss);
+	expected << "y\n";
+	for(int i = 0; i < 200; i++)
+		expected << "y" << i << "\n";
+	EXPECT_EQ(ss.str(), expected.str());
+}
+
+
+TEST(NgramIndexTest, select_sameResultWithIndex)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	sheet.add_row({"apple"});
+	sheet.add_row({"Snapple"});
+	sheet.set_ngram_index(sheet.resolve_column("Food"));
+	sheet.add_row({"app"});
+	sheet.add_row({"pineapple pie"});
+	sheet.add_row({"grape"});
+	sheet.cell_data(4, 0) = "applesauce";
+	sheet.cell_data(1, 0) = "orange";
+
+	EXPECT_EQ(sheet.ngram_index(0)->candidates("ppl"), std::vector<int>({0, 1, 3, 4}));
+
+	sheet.set_selection(new Select_Contains(&sheet,"Food","apple"));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "apple\npineapple pie\napplesauce\n");
+
+	sheet.set_selection(new Select_Contains(&sheet,"Food","ap"));
+	std::stringstream shortNeedle;
+	sheet.print_selection(shortNeedle);
+	EXPECT_EQ(shortNeedle.str(), "apple\napp\npineapple pie\napplesauce\n");
+}
+
+
+TEST(ResultCacheTest, reuseAndInvalidate)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Name", "Pet"});
+	sheet.add_row({"Jane","Cat"});
+	sheet.add_row({"John","Dog"});
+	sheet.set_result_cache_size(16);
+
+	Select_Contains dog(&sheet,"Pet","Dog");
+	Select_And both(
+		new Select_Contains(&sheet,"Pet","Dog"),
+		new Select_Contains(&sheet,"Name","John"));
+	Select_And swapped(
+		new Select_Contains(&sheet,"Name","John"),
+		new Select_Contains(&sheet,"Pet","Dog"));
+	EXPECT_EQ(both.fingerprint(), swapped.fingerprint());
+	EXPECT_NE(sheet.cached_result(both.fingerprint()), nullptr);
+	EXPECT_NE(sheet.cached_result(dog.fingerprint()), nullptr);
+
+	// Overwriting a cell changes the version, so the old rows are not reused.
+	unsigned long version = sheet.get_version();
+	sheet.cell_data(0, 1) = "Dog";
+	EXPECT_NE(sheet.get_version(), version);
+	EXPECT_EQ(sheet.cached_result(dog.fingerprint()), nullptr);
+
+	sheet.set_selection(new Select_Contains(&sheet,"Pet","Dog"));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "Jane Dog\nJohn Dog\n");
+}
+
+TEST(ResultCacheTest, staleResultNotStored)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	sheet.add_row({"x"});
+	sheet.set_result_cache_size(16);
+
+	Select* x = new Select_Contains(&sheet,"Food","x");
+	Select* y = new Select_Contains(&sheet,"Food","y");
+	sheet.add_row({"y"});
+	Select_Or* stale = new Select_Or(x, y);
+	EXPECT_EQ(stale->bitmap()->size(), 1);
+	EXPECT_EQ(sheet.cached_result(stale->fingerprint()), nullptr);
+	delete stale;
+
+	Select_Or fresh(new Select_Contains(&sheet,"Food","x"), new Select_Contains(&sheet,"Food","y"));
+	EXPECT_EQ(fresh.bitmap()->count(), 2);
+	EXPECT_NE(sheet.cached_result(fresh.fingerprint()), nullptr);
+}
+
+
+TEST(IncrementalSelectTest, select_growsOnAppend)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	for(int i = 0; i < 60; i++)
+		sheet.add_row({i % 2 ? "apple" : "pear"});
+
+	sheet.set_selection(
+		new Select_And(
+			new Select_Contains(&sheet,"Food","p"),
+			new Select_Not(
+				new Select_Contains(&sheet,"Food","pear"))));
+
+	std::string expected;
+	for(int i = 0; i < 60; i++)
+		if(i % 2)
+			expected += "apple\n";
+	for(int i = 60; i < 140; i++){
+		sheet.add_row({i % 3 ? "pineapple" : "kiwi"});
+		if(i % 3)
+			expected += "pineapple\n";
+	}
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), expected);
+}
+
+TEST(IncrementalSelectTest, select_builtBeforeLastRows)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	for(int i = 0; i < 5; i++)
+		sheet.add_row({"apple"});
+	Select* first = new Select_Contains(&sheet,"Food","apple");
+	Select* second = new Select_Contains(&sheet,"Food","pl");
+	sheet.add_row({"apple"});
+
+	sheet.set_selection(new Select_Or(first, second));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "apple\napple\napple\napple\napple\napple\n");
+}
+
+TEST(IncrementalSelectTest, select_childrenBuiltAtDifferentRowCounts)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	sheet.add_row({"apple"});
+	sheet.add_row({"apple"});
+	Select* first = new Select_Contains(&sheet,"Food","apple");
+	sheet.add_row({"apple"});
+	Select* second = new Select_Contains(&sheet,"Food","pl");
+	sheet.add_row({"apple"});
+
+	sheet.set_selection(new Select_And(first, second));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "apple\napple\napple\napple\n");
+
+	first = new Select_Contains(&sheet,"Food","apple");
+	sheet.add_row({"pear"});
+	sheet.add_row({"apple"});
+	second = new Select_Contains(&sheet,"Food","pear");
+	sheet.set_selection(new Select_Not(new Select_Or(second, first)));
+	std::stringstream none;
+	sheet.print_selection(none);
+	EXPECT_EQ(none.str(), "");
+}
+
+
+TEST(QueryPoolTest, nodesAndBitmapsAreRecycled)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	for(int i = 0; i < 1000; i++)
+		sheet.add_row({i % 2 ? "apple" : "pear"});
+
+	auto query = [&sheet]() {
+		return new Select_Or(
+			new Select_Contains(&sheet,"Food","apple"),
+			new Select_Not(
+				new Select_Contains(&sheet,"Food","ear")));
+	};
+	delete query();
+	std::size_t retained = Query_Pool::retained();
+	EXPECT_GT(retained, 0u);
+
+	// A second query of the same shape is served from the free lists, and
+	// deleting the root returns every node and bitmap to them.
+	Select* again = query();
+	EXPECT_LT(Query_Pool::retained(), retained);
+	delete again;
+	EXPECT_EQ(Query_Pool::retained(), retained);
+}
+
+
+TEST(QueryTest, compileMatchesHandBuiltTree)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"First","Last","Age"});
+	sheet.add_row({"Amanda","Andrews","22"});
+	sheet.add_row({"Brian","Becker","21"});
+	sheet.add_row({"Carol","Conners","21"});
+	sheet.add_row({"Joe","Jackson","21"});
+	sheet.add_row({"Sarah","Summers","21"});
+	sheet.add_row({"Diane","Dole","20"});
+	sheet.add_row({"David","Dole","22"});
+	sheet.add_row({"Dominick","Dole","22"});
+	sheet.add_row({"George","Genius","9"});
+
+	Query query(&sheet, "Last ~ \"Dole\" and not (First ~ \"v\" OR TRUE AND First ~ \"v\")");
+	EXPECT_EQ(query.explain(), "AND(Last ~ \"Dole\", NOT(First ~ \"v\"))");
+	sheet.set_selection(query.compile());
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "Diane Dole 20\nDominick Dole 22\n");
+}
+
+TEST(QueryTest, planFoldsFlattensAndOrders)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food","Zip Code"});
+	for(int i = 0; i < 100; i++)
+		sheet.add_row({i % 10 ? "apple" : "kiwi", "92507"});
+
+	// Rare predicates lead an AND, common ones lead an OR; unknown columns
+	// and empty needles are decided without scanning.
+	EXPECT_EQ(Query(&sheet, "Food ~ \"p\" AND (\"Zip Code\" ~ \"9\" AND Food ~ \"kiwi\")").explain(),
+		"AND(Food ~ \"kiwi\", Food ~ \"p\", \"Zip Code\" ~ \"9\")");
+	EXPECT_EQ(Query(&sheet, "Food ~ \"kiwi\" OR Food ~ \"p\" OR Food ~ \"kiwi\"").explain(),
+		"OR(Food ~ \"p\", Food ~ \"kiwi\")");
+	EXPECT_EQ(Query(&sheet, "Color ~ \"red\" OR NOT NOT Food ~ \"\"").explain(), "TRUE");
+	EXPECT_NEAR(Query(&sheet, "Food ~ \"kiwi\"").selectivity(), 0.1, 0.01);
+
+	try{
+		Query(&sheet, "Food ~ \"kiwi\" AND");
+		FAIL();
+	}
+	catch(const Query_Error& e){
+		EXPECT_EQ(e.position(), 17u);
+	}
+}
+
+
+TEST(ProfileTest, countersPerNodeAndPrint)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	for(int i = 0; i < 100; i++)
+		sheet.add_row({i % 4 ? "apple" : "pear"});
+
+	sheet.set_selection(
+		new Select_And(
+			new Select_Contains(&sheet,"Food","p"),
+			new Select_Not(
+				new Select_Contains(&sheet,"Food","ear"))));
+	std::stringstream ss;
+	sheet.print_selection(ss);
+
+	Query_Profile report = sheet.profile();
+	ASSERT_EQ(report.nodes.size(), 4u);
+	EXPECT_EQ(report.nodes[0].node, "And");
+	EXPECT_EQ(report.nodes[0].rows_matched, 75u);
+	EXPECT_EQ(report.nodes[1].node, "Contains(Food ~ \"p\")");
+	EXPECT_EQ(report.nodes[1].depth, 1);
+	EXPECT_EQ(report.nodes[1].rows_scanned, 100u);
+	EXPECT_EQ(report.nodes[1].rows_matched, 100u);
+	EXPECT_EQ(report.nodes[1].bytes_compared, 75u * 5 + 25u * 4);
+	EXPECT_EQ(report.nodes[3].depth, 2);
+	EXPECT_EQ(report.nodes[3].rows_matched, 25u);
+	EXPECT_EQ(report.rows_emitted, 75u);
+	EXPECT_EQ(report.bytes_written, ss.str().size());
+	EXPECT_NE(report.str().find("Not: scanned 100, matched 75"), std::string::npos);
+
+	sheet.reset_profile();
+	report = sheet.profile();
+	EXPECT_EQ(report.nodes[1].rows_scanned, 0u);
+	EXPECT_EQ(report.rows_emitted, 0u);
+}
+
+TEST(ProfileTest, lazyNodesCountPerRow)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food"});
+	for(int i = 0; i < 100; i++)
+		sheet.add_row({i % 4 ? "apple" : "pear"});
+	sheet.set_evaluation(Spreadsheet::LAZY);
+	sheet.set_selection(new Select_Contains(&sheet,"Food","pe"));
+	sheet.reset_profile();
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	Query_Profile report = sheet.profile();
+	EXPECT_EQ(report.nodes[0].rows_scanned, 0u);
+	EXPECT_EQ(report.rows_emitted, 25u);
+
+	sheet.set_profiling(true);
+	EXPECT_TRUE(sheet.get_profiling());
+	sheet.reset_profile();
+	sheet.print_selection(ss);
+	report = sheet.profile();
+	EXPECT_EQ(report.nodes[0].rows_scanned, 100u);
+	EXPECT_EQ(report.nodes[0].rows_matched, 25u);
+	EXPECT_EQ(report.rows_emitted, 25u);
+
+	sheet.set_selection(new Select_Not(new Select_Contains(&sheet,"Food","pe")));
+	sheet.reset_profile();
+	sheet.print_selection(ss);
+	report = sheet.profile();
+	EXPECT_EQ(report.nodes[0].rows_matched, 75u);
+	EXPECT_EQ(report.nodes[1].rows_scanned, 100u);
+}
+
+
+TEST(ProjectionTest, printNamedColumnsOnly)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"First","Last","Age","Major"});
+	sheet.add_row({"Amanda","Andrews","22","business"});
+	sheet.add_row({"Brian","Becker","21","computer science"});
+	sheet.add_row({"Diane","Dole","20","computer engineering"});
+	sheet.set_selection(new Select_Contains(&sheet,"Major","computer"));
+
+	std::stringstream ss;
+	sheet.print_selection(ss, {"Age","First"});
+	EXPECT_EQ(ss.str(), "21 Brian\n20 Diane\n");
+
+	std::stringstream all, listed;
+	sheet.print_selection(all);
+	sheet.print_selection(listed, {"First","Last","Age","Major"});
+	EXPECT_EQ(listed.str(), all.str());
+
+	EXPECT_THROW(sheet.print_selection(ss, {"First","Gpa"}), std::out_of_range);
+}
+
+
+TEST(SelectionRangeTest, iterateSelectedRows)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Food","Id"});
+	for(int i = 0; i < 200; i++)
+		sheet.add_row({i % 70 == 3 ? "pear" : "apple", std::to_string(i)});
+
+	EXPECT_EQ(sheet.selected_rows().size(), 200);
+
+	Column_Handle id = sheet.resolve_column("Id");
+	for(int lazy = 0; lazy < 2; lazy++){
+		sheet.set_evaluation(lazy ? Spreadsheet::LAZY : Spreadsheet::EAGER);
+		sheet.set_selection(new Select_Contains(&sheet,"Food","pear"));
+
+		std::vector<int> rows;
+		std::vector<std::string> ids;
+		for(Row_View row : sheet.selected_rows()){
+			rows.push_back(row.index());
+			ids.push_back(row[id]);
+		}
+		EXPECT_EQ(rows, std::vector<int>({3, 73, 143}));
+		EXPECT_EQ(ids, std::vector<std::string>({"3", "73", "143"}));
+		EXPECT_EQ(sheet.selected_rows().size(), 3);
+
+		Selection_Range range = sheet.selected_rows();
+		EXPECT_EQ(std::count_if(range.begin(), range.end(),
+			[](const Row_View& row){ return row[0] == "pear"; }), 3);
+	}
+
+	sheet.set_evaluation(Spreadsheet::EAGER);
+	sheet.set_selection(new Select_Contains(&sheet,"Food","kiwi"));
+	EXPECT_TRUE(sheet.selected_rows().empty());
+}
+
+
+TEST(TypedColumnTest, compareIntsNotSubstrings)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"First","Age"});
+	sheet.add_row({"Amanda","19"});
+	sheet.add_row({"Brian","9"});
+	sheet.add_row({"Carol","90"});
+	sheet.add_row({"Joe","unknown"});
+	sheet.add_row({"Sarah","29"});
+	sheet.set_column_type(sheet.resolve_column("Age"), Typed_Column::INT64);
+
+	auto names = [&sheet]() {
+		std::stringstream ss;
+		sheet.print_selection(ss, {"First"});
+		return ss.str();
+	};
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::EQUAL,"9"));
+	EXPECT_EQ(names(), "Brian\n");
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::LESS,"29"));
+	EXPECT_EQ(names(), "Amanda\nBrian\n");
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::GREATER_EQUAL,"29"));
+	EXPECT_EQ(names(), "Carol\nSarah\n");
+	sheet.set_selection(new Select_Not(new Select_Between(&sheet,"Age","10","89")));
+	EXPECT_EQ(names(), "Brian\nCarol\nJoe\n");
+
+	// Appended rows and overwritten cells are parsed as they arrive.
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::LESS_EQUAL,"19"));
+	sheet.add_row({"Diane","-4"});
+	sheet.cell_data(3, 1) = "12";
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::LESS_EQUAL,"19"));
+	EXPECT_EQ(names(), "Amanda\nBrian\nJoe\nDiane\n");
+
+	EXPECT_THROW(Select_Compare(&sheet,"Age",Select_Compare::LESS,"ten"), std::invalid_argument);
+	EXPECT_THROW(Select_Compare(&sheet,"First",Select_Compare::LESS,"1"), std::logic_error);
+}
+
+TEST(TypedColumnTest, doublesAndDatesAcrossBlocks)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Score","Day"});
+	for(int i = 0; i < 300; i++){
+		int day = 1 + i % 28;
+		sheet.add_row({std::to_string(i * 0.5), std::string("2024-02-") + (day < 10 ? "0" : "") + std::to_string(day)});
+	}
+	sheet.set_column_type(sheet.resolve_column("Score"), Typed_Column::DOUBLE);
+	sheet.set_column_type(sheet.resolve_column("Day"), Typed_Column::DATE);
+
+	Select_Compare above(&sheet,"Score",Select_Compare::GREATER,"70.5");
+	int expected = 0;
+	for(int i = 0; i < 300; i++)
+		expected += i * 0.5 > 70.5;
+	EXPECT_EQ(above.bitmap()->count(), expected);
+
+	Select_Between week(&sheet,"Day","2024-02-08","2024-02-14");
+	for(int i = 0; i < 300; i++)
+		EXPECT_EQ(week.select(i), 1 + i % 28 >= 8 && 1 + i % 28 <= 14) << i;
+
+	int64_t days;
+	EXPECT_TRUE(Typed_Column::parse_date(std::string("1970-01-02"), days));
+	EXPECT_EQ(days, 1);
+	EXPECT_FALSE(Typed_Column::parse_date(std::string("2023-02-29"), days));
+
+	double real;
+	EXPECT_TRUE(Typed_Column::parse_double(std::string("-1.5e3"), real));
+	EXPECT_EQ(real, -1500.0);
+	EXPECT_TRUE(Typed_Column::parse_double(std::string(".5"), real));
+	const char* rejected[] = {"nan", "inf", "-Infinity", "0x1p3", " 1", "1e", "1e999", "."};
+	for(const char* text : rejected)
+		EXPECT_FALSE(Typed_Column::parse_double(std::string(text), real)) << text;
+
+	Typed_Column scores(Typed_Column::DOUBLE);
+	scores.append(std::string("nan"));
+	scores.append(std::string("2.5"));
+	EXPECT_FALSE(scores.present().test(0));
+	EXPECT_TRUE(scores.present().test(1));
+}
+
+TEST(TypedColumnTest, retypedColumnUnderInstalledRange)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Age"});
+	sheet.add_row({"19"});
+	sheet.add_row({"40"});
+	sheet.set_column_type(sheet.resolve_column("Age"), Typed_Column::INT64);
+	sheet.set_selection(new Select_Compare(&sheet,"Age",Select_Compare::LESS,"20"));
+
+	sheet.set_column_type(sheet.resolve_column("Age"), Typed_Column::TEXT);
+	EXPECT_NO_THROW(sheet.add_row({"5"}));
+	sheet.set_column_type(sheet.resolve_column("Age"), Typed_Column::DOUBLE);
+	EXPECT_NO_THROW(sheet.add_row({"6"}));
+	EXPECT_EQ(sheet.get_row_size(), 4);
+
+	std::stringstream ss;
+	sheet.print_selection(ss);
+	EXPECT_EQ(ss.str(), "19\n");
+}
+
+
+TEST(ZoneMapTest, skipBlocksThatCannotMatch)
+{
+	// Roughly time-ordered data: each 4096-row block holds one month.
+	const char* months[] = {"jan", "feb", "mar", "apr"};
+	Spreadsheet sheet;
+	sheet.set_column_names({"Month","Seq"});
+	for(int i = 0; i < 4 * 4096; i++)
+		sheet.add_row({std::string(months[i / 4096]) + "-" + std::to_string(i % 97), std::to_string(i)});
+	sheet.set_zone_map(sheet.resolve_column("Month"));
+	sheet.set_column_type(sheet.resolve_column("Seq"), Typed_Column::INT64);
+
+	Select_Contains mar(&sheet,"Month","mar-");
+	EXPECT_EQ(mar.bitmap()->count(), 4096);
+	EXPECT_TRUE(mar.select(2 * 4096) && !mar.select(2 * 4096 - 1));
+	EXPECT_EQ(mar.statistics().rows_scanned, 4096u);
+
+	Select_Between seq(&sheet,"Seq","5000","6000");
+	EXPECT_EQ(seq.bitmap()->count(), 1001);
+	EXPECT_EQ(seq.statistics().rows_scanned, 4096u);
+
+	// Summaries widen on overwrite and append, so nothing is missed.
+	sheet.cell_data(10, 0) = "mar-x";
+	sheet.add_row({"mar-y", "1"});
+	Select_Contains again(&sheet,"Month","mar-");
+	EXPECT_EQ(again.bitmap()->count(), 4098);
+	EXPECT_TRUE(again.select(10) && again.select(4 * 4096));
+	EXPECT_EQ(Select_Contains(&sheet,"Month","may").bitmap()->count(), 0);
+}
+
+
+TEST(SortTest, orderByColumnsWithLimit)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"First","Last","Age"});
+	sheet.add_row({"Amanda","Andrews","22"});
+	sheet.add_row({"Brian","Becker","21"});
+	sheet.add_row({"Diane","Dole","20"});
+	sheet.add_row({"David","Dole","9"});
+	sheet.add_row({"Dominick","Dole","22"});
+	sheet.add_row({"George","Genius","?"});
+	sheet.set_column_type(sheet.resolve_column("Age"), Typed_Column::INT64);
+	sheet.set_selection(new Select_Not(new Select_Contains(&sheet,"First","Brian")));
+
+	std::stringstream ss;
+	sheet.print_sorted(ss, {"Last", {"Age", true}});
+	EXPECT_EQ(ss.str(), "Amanda Andrews 22\nDominick Dole 22\nDiane Dole 20\n"
+		"David Dole 9\nGeorge Genius ?\n");
+
+	// Numeric, not byte, order; the unparsable age sorts last.
+	EXPECT_EQ(sheet.sorted_rows({"Age"}), std::vector<int>({3, 2, 0, 4, 5}));
+	EXPECT_EQ(sheet.sorted_rows({"Age"}, 2), std::vector<int>({3, 2}));
+	EXPECT_EQ(sheet.sorted_rows({{"Age", true}}, 2), std::vector<int>({0, 4}));
+	EXPECT_TRUE(sheet.sorted_rows({"Age"}, 0).empty());
+	EXPECT_THROW(sheet.sorted_rows({"Gpa"}), std::out_of_range);
+}
+
+TEST(SortTest, topKMatchesFullSort)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Key"});
+	unsigned seed = 7;
+	for(int i = 0; i < 5000; i++){
+		seed = seed * 1103515245u + 12345u;
+		sheet.add_row({std::to_string((seed >> 16) % 1000)});
+	}
+	sheet.set_selection(new Select_Contains(&sheet,"Key","1"));
+
+	std::vector<int> all = sheet.sorted_rows({{"Key", true}});
+	std::vector<int> top = sheet.sorted_rows({{"Key", true}}, 50);
+	ASSERT_EQ(top.size(), 50u);
+	EXPECT_EQ(top, std::vector<int>(all.begin(), all.begin() + 50));
+}
+
+
+TEST(GroupByTest, countAndStatsByMajor)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"First","Major","Age"});
+	sheet.add_row({"Amanda","business","22"});
+	sheet.add_row({"Brian","computer science","21"});
+	sheet.add_row({"Carol","business","20"});
+	sheet.add_row({"Joe","computer science","?"});
+	sheet.add_row({"Sarah","math","25"});
+	sheet.add_row({"Diane","business","27"});
+	sheet.set_selection(new Select_Not(new Select_Contains(&sheet,"Major","math")));
+
+	std::vector<Group_Row> groups = sheet.group_by({"Major"},
+		{Aggregate::COUNT, {Aggregate::SUM,"Age"}, {Aggregate::MIN,"Age"},
+		 {Aggregate::MAX,"Age"}, {Aggregate::AVG,"Age"}});
+	ASSERT_EQ(groups.size(), 2u);
+	EXPECT_EQ(groups[0].keys, std::vector<std::string>({"business"}));
+	EXPECT_EQ(groups[0].values, std::vector<double>({3, 69, 20, 27, 23}));
+	EXPECT_EQ(groups[1].keys, std::vector<std::string>({"computer science"}));
+	EXPECT_EQ(groups[1].values, std::vector<double>({2, 21, 21, 21, 21}));
+
+	EXPECT_THROW(sheet.group_by({"Dept"}, {Aggregate::COUNT}), std::out_of_range);
+}
+
+TEST(GroupByTest, parallelMatchesSerial)
+{
+	Spreadsheet sheet;
+	sheet.set_column_names({"Dept","Team","Score"});
+	for(int i = 0; i < 100000; i++)
+		sheet.add_row({"d" + std::to_string(i % 7), "t" + std::to_string(i % 3), std::to_string(i % 1000)});
+	sheet.set_column_type(sheet.resolve_column("Score"), Typed_Column::INT64);
+	sheet.set_selection(new Select_Compare(&sheet,"Score",Select_Compare::LESS,"500"));
+
+	std::vector<Aggregate> aggregates = {Aggregate::COUNT, {Aggregate::SUM,"Score"}, {Aggregate::MAX,"Score"}};
+	std::vector<Group_Row> serial = sheet.group_by({"Dept","Team"}, aggregates);
+	sheet.set_thread_count(4);
+	std::vector<Group_Row> parallel = sheet.group_by({"Dept","Team"}, aggregates);
+
+	ASSERT_EQ(serial.size(), 21u);
+	ASSERT_EQ(parallel.size(), serial.size());
+	double total = 0;
+	for(int g = 0; g < serial.size(); g++){
+		EXPECT_EQ(parallel[g].keys, serial[g].keys);
+		EXPECT_EQ(parallel[g].values, serial[g].values);
+		total += serial[g].values[0];
+	}
+	EXPECT_EQ(total, 50000);
+}
+
+
+TEST(HashJoinTest, joinSelectedRowsIntoNewSheet)
+{
+	Spreadsheet students;
+	students.set_column_names({"First","Major"});
+	students.add_row({"Amanda","business"});
+	students.add_row({"Brian","computer science"});
+	students.add_row({"Carol","art"});
+	students.add_row({"Joe","computer science"});
+	students.add_row({"Sarah","math"});
+
+	Spreadsheet majors;
+	majors.set_column_names({"Name","Building"});
+	majors.add_row({"computer science","Bourns"});
+	majors.add_row({"business","Anderson"});
+	majors.add_row({"math","Skye"});
+	majors.add_row({"computer science","Winston"});
+	majors.set_selection(new Select_Not(new Select_Contains(&majors,"Building","Skye")));
+
+	Hash_Join join(students, {"Major"}, majors, {"Name"});
+	std::vector<std::pair<int,int> > pairs(join.begin(), join.end());
+	EXPECT_EQ(pairs, (std::vector<std::pair<int,int> >{{0,1}, {1,0}, {1,3}, {3,0}, {3,3}}));
+
+	Spreadsheet report;
+	join.materialize(report);
+	std::stringstream ss;
+	report.print_selection(ss, {"First","Building"});
+	EXPECT_EQ(ss.str(), "Amanda Anderson\nBrian Bourns\nBrian Winston\nJoe Bourns\nJoe Winston\n");
+
+	// The pre-filter on the other side, with the build side swapped.
+	students.set_selection(new Select_Contains(&students,"First","o"));
+	Hash_Join swapped(majors, {"Name"}, students, {"Major"});
+	std::vector<std::pair<int,int> > rows(swapped.begin(), swapped.end());
+	EXPECT_EQ(rows, (std::vector<std::pair<int,int> >{{0,3}, {3,3}}));
+
+	EXPECT_THROW(Hash_Join(students, {"Major"}, majors, {"Dept"}), std::out_of_range);
+	EXPECT_THROW(Hash_Join(students, {"Major","First"}, majors, {"Name"}), std::invalid_argument);
+
+	int student_rows = students.get_row_size();
+	EXPECT_THROW(join.materialize(students), std::invalid_argument);
+	EXPECT_THROW(join.materialize(majors), std::invalid_argument);
+	EXPECT_EQ(students.get_row_size(), student_rows);
+}
+
+
 
 
 
@@ -0,0 +1,122 @@
+#include "substring_search.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUBSTRING_SEARCH_X86 1
+#endif
+
+namespace
+{
+
+std::size_t find_scalar(const char* text, std::size_t length,
+                        const char* needle, std::size_t n)
+{
+    if(n == 0)
+        return 0;
+    if(n > length)
+        return Substring_Matcher::npos;
+    const char* p = text;
+    const char* last = text + length - n;
+    while(p <= last)
+    {
+        p = static_cast<const char*>(std::memchr(p, needle[0], last - p + 1));
+        if(!p)
+            return Substring_Matcher::npos;
+        if(std::memcmp(p + 1, needle + 1, n - 1) == 0)
+            return p - text;
+        p++;
+    }
+    return Substring_Matcher::npos;
+}
+
+#ifdef SUBSTRING_SEARCH_X86
+
+// For each block of candidate start positions, compare the needle's first
+// byte against text[i..] and its last byte against text[i + n - 1..]; only
+// positions where both match get a full memcmp.  Positions too close to the
+// end for a whole block fall back to the scalar loop.
+
+__attribute__((target("sse2")))
+std::size_t find_sse2(const char* text, std::size_t length,
+                      const char* needle, std::size_t n)
+{
+    if(n < 2)
+        return find_scalar(text, length, needle, n);
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    std::size_t i = 0;
+    for(; i + n - 1 + 16 <= length; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                        _mm_cmpeq_epi8(last, block_last)));
+        while(mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if(std::memcmp(text + i + bit + 1, needle + 1, n - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    std::size_t rest = find_scalar(text + i, length - i, needle, n);
+    return rest == Substring_Matcher::npos ? rest : i + rest;
+}
+
+__attribute__((target("avx2")))
+std::size_t find_avx2(const char* text, std::size_t length,
+                      const char* needle, std::size_t n)
+{
+    if(n < 2)
+        return find_scalar(text, length, needle, n);
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    std::size_t i = 0;
+    for(; i + n - 1 + 32 <= length; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + n - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                                                              _mm256_cmpeq_epi8(last, block_last)));
+        while(mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if(std::memcmp(text + i + bit + 1, needle + 1, n - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    std::size_t rest = find_sse2(text + i, length - i, needle, n);
+    return rest == Substring_Matcher::npos ? rest : i + rest;
+}
+
+#endif
+
+}
+
+Substring_Matcher::Substring_Matcher(const std::string& needle)
+    : needle(needle), kernel(find_scalar)
+{
+#ifdef SUBSTRING_SEARCH_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        kernel = find_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        kernel = find_sse2;
+#endif
+}
+
+const char* Substring_Matcher::kernel_name() const
+{
+#ifdef SUBSTRING_SEARCH_X86
+    if(kernel == find_avx2)
+        return "avx2";
+    if(kernel == find_sse2)
+        return "sse2";
+#endif
+    return "scalar";
+}
@@ -0,0 +1,46 @@
+#ifndef __SUBSTRING_SEARCH_HPP__
+#define __SUBSTRING_SEARCH_HPP__
+
+#include <cstddef>
+#include <string>
+
+// Substring search specialized once for a fixed needle.  The constructor
+// picks the widest kernel the CPU supports (AVX2, then SSE2, then a portable
+// memchr/memcmp loop); the vector kernels compare the needle's first and last
+// bytes against a whole block of candidate positions at once and only run a
+// full comparison where both agree.
+class Substring_Matcher
+{
+public:
+    typedef std::size_t (*Kernel)(const char* text, std::size_t length,
+                                  const char* needle, std::size_t needle_length);
+
+private:
+    std::string needle;
+    Kernel kernel;
+
+public:
+    static const std::size_t npos = std::string::npos;
+
+    explicit Substring_Matcher(const std::string& needle);
+
+    // Position of the first occurrence of the needle in text, or npos.
+    std::size_t find(const char* text, std::size_t length) const
+    {
+        if(needle.size() > length)
+            return npos;
+        return kernel(text, length, needle.data(), needle.size());
+    }
+
+    bool contains(const char* text, std::size_t length) const
+    {
+        return find(text, length) != npos;
+    }
+
+    const std::string& pattern() const { return needle; }
+
+    // Name of the kernel in use ("avx2", "sse2" or "scalar").
+    const char* kernel_name() const;
+};
+
+#endif //__SUBSTRING_SEARCH_HPP__
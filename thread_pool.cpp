@@ -0,0 +1,108 @@
+#include "thread_pool.hpp"
+
+Thread_Pool::Thread_Pool(int threads)
+    : next_chunk(0)
+{
+    for(int i = 1; i < threads; i++)
+        workers.push_back(std::thread(&Thread_Pool::worker_loop, this));
+}
+
+Thread_Pool::~Thread_Pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(int i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void Thread_Pool::run_chunks()
+{
+    for(;;)
+    {
+        long long first = (long long)next_chunk.fetch_add(1) * job_grain + job_begin;
+        if(first >= job_end)
+            return;
+        int last = first + job_grain < job_end ? first + job_grain : job_end;
+        try
+        {
+            (*body)(first, last);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(!failure)
+                failure = std::current_exception();
+            // Hand out no more chunks.
+            next_chunk = (job_end - job_begin + job_grain - 1) / job_grain;
+            return;
+        }
+    }
+}
+
+void Thread_Pool::worker_loop()
+{
+    unsigned seen = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if(stopping)
+                return;
+            seen = generation;
+            busy++;
+            checked_in++;
+        }
+
+        run_chunks();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(--busy == 0)
+            finished.notify_all();
+    }
+}
+
+void Thread_Pool::parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+    if(begin >= end)
+        return;
+    if(grain < 1)
+        grain = 1;
+    if(workers.empty() || end - begin <= grain)
+    {
+        for(int i = begin; i < end; i += grain)
+            body(i, end - i > grain ? i + grain : end);
+        return;
+    }
+
+    std::lock_guard<std::mutex> job(job_lock);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->body = &body;
+        job_begin = begin;
+        job_end = end;
+        job_grain = grain;
+        next_chunk = 0;
+        checked_in = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    run_chunks();
+
+    // Wait for every worker to have picked up this job, not just for the
+    // busy ones to finish, so no worker can wake late and read the next
+    // job's state half-written.
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&] { return busy == 0 && checked_in == (int)workers.size(); });
+    this->body = nullptr;
+    if(failure)
+    {
+        std::exception_ptr error = failure;
+        failure = nullptr;
+        std::rethrow_exception(error);
+    }
+}
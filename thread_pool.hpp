@@ -0,0 +1,58 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that split a row range between them.  The
+// calling thread works on the range too, so a pool of size N runs N-1
+// workers.  parallel_for calls are serialized; the body must not call back
+// into the same pool.
+class Thread_Pool
+{
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::mutex job_lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // The job currently being run.
+    const std::function<void(int, int)>* body = nullptr;
+    int job_begin = 0;
+    int job_end = 0;
+    int job_grain = 1;
+    std::atomic<int> next_chunk;
+    int busy = 0;
+    int checked_in = 0;
+    unsigned generation = 0;
+    bool stopping = false;
+    // The first exception thrown by the body during the current job.
+    std::exception_ptr failure;
+
+    void run_chunks();
+    void worker_loop();
+
+public:
+    explicit Thread_Pool(int threads);
+    ~Thread_Pool();
+
+    Thread_Pool(const Thread_Pool&) = delete;
+    Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+    // Threads taking part in a parallel_for, counting the caller.
+    int size() const { return workers.size() + 1; }
+
+    // Call body(chunk_begin, chunk_end) for consecutive chunks of at most
+    // grain rows covering [begin, end).  Returns once every chunk is done.
+    // If body throws, no further chunks are started and the first exception
+    // is rethrown once the running ones have returned.
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body);
+};
+
+#endif //__THREAD_POOL_HPP__
@@ -0,0 +1,165 @@
+#include "typed_column.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+namespace
+{
+
+bool digits(const char* p, int n, int64_t& value)
+{
+    value = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(p[i] < '0' || p[i] > '9')
+            return false;
+        value = value * 10 + (p[i] - '0');
+    }
+    return n > 0;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date.
+int64_t days_from_civil(int64_t y, int64_t m, int64_t d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+}
+
+bool Typed_Column::parse_int(Cell_View text, int64_t& value)
+{
+    const char* p = text.data();
+    std::size_t n = text.size();
+    bool negative = n && p[0] == '-';
+    std::size_t i = n && (p[0] == '-' || p[0] == '+');
+    if(i == n)
+        return false;
+
+    uint64_t magnitude = 0;
+    uint64_t limit = negative ? uint64_t(std::numeric_limits<int64_t>::max()) + 1
+                              : uint64_t(std::numeric_limits<int64_t>::max());
+    for(; i < n; i++)
+    {
+        if(p[i] < '0' || p[i] > '9')
+            return false;
+        unsigned digit = p[i] - '0';
+        if(magnitude > (limit - digit) / 10)
+            return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    value = negative ? int64_t(0 - magnitude) : int64_t(magnitude);
+    return true;
+}
+
+bool Typed_Column::parse_double(Cell_View text, double& value)
+{
+    // Only plain decimals, [+-]digits[.digits][e[+-]digits]: strtod would
+    // also take leading spaces, hex, "inf" and "nan", and a NaN cell would
+    // break sorting and MIN/MAX.
+    const char* p = text.data();
+    std::size_t n = text.size();
+    std::size_t i = n && (p[0] == '-' || p[0] == '+');
+    std::size_t digits = 0;
+    for(; i < n && p[i] >= '0' && p[i] <= '9'; i++)
+        digits++;
+    if(i < n && p[i] == '.')
+        for(i++; i < n && p[i] >= '0' && p[i] <= '9'; i++)
+            digits++;
+    if(digits == 0)
+        return false;
+    if(i < n && (p[i] == 'e' || p[i] == 'E'))
+    {
+        i++;
+        if(i < n && (p[i] == '-' || p[i] == '+'))
+            i++;
+        if(i == n || p[i] < '0' || p[i] > '9')
+            return false;
+        while(i < n && p[i] >= '0' && p[i] <= '9')
+            i++;
+    }
+    if(i != n)
+        return false;
+
+    std::string copy = text.str();
+    value = std::strtod(copy.c_str(), nullptr);
+    return std::isfinite(value);
+}
+
+bool Typed_Column::parse_date(Cell_View text, int64_t& value)
+{
+    const char* p = text.data();
+    int64_t y, m, d;
+    if(text.size() != 10 || p[4] != '-' || p[7] != '-' ||
+       !digits(p, 4, y) || !digits(p + 5, 2, m) || !digits(p + 8, 2, d))
+        return false;
+    static const int month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if(m < 1 || m > 12 || d < 1 || d > month_days[m - 1] + (m == 2 && leap))
+        return false;
+    value = days_from_civil(y, m, d);
+    return true;
+}
+
+void Typed_Column::append(Cell_View cell)
+{
+    int row = size();
+    valid.resize(row + 1);
+    if(kind == DOUBLE)
+        reals.push_back(0.0);
+    else
+        ints.push_back(0);
+    assign(row, cell);
+}
+
+void Typed_Column::assign(int row, Cell_View cell)
+{
+    bool ok = false;
+    if(kind == DOUBLE)
+    {
+        double value;
+        ok = parse_double(cell, value);
+        reals[row] = ok ? value : 0.0;
+    }
+    else
+    {
+        int64_t value;
+        ok = kind == DATE ? parse_date(cell, value) : parse_int(cell, value);
+        ints[row] = ok ? value : 0;
+    }
+    if(!ok)
+    {
+        valid.reset(row);
+        return;
+    }
+    valid.set(row);
+
+    std::size_t block = row / Zone_Map::block_rows;
+    if(kind == DOUBLE)
+    {
+        if(real_min.size() <= block)
+        {
+            real_min.resize(block + 1, std::numeric_limits<double>::infinity());
+            real_max.resize(block + 1, -std::numeric_limits<double>::infinity());
+        }
+        real_min[block] = std::min(real_min[block], reals[row]);
+        real_max[block] = std::max(real_max[block], reals[row]);
+    }
+    else
+    {
+        if(int_min.size() <= block)
+        {
+            int_min.resize(block + 1, std::numeric_limits<int64_t>::max());
+            int_max.resize(block + 1, std::numeric_limits<int64_t>::min());
+        }
+        int_min[block] = std::min(int_min[block], ints[row]);
+        int_max[block] = std::max(int_max[block], ints[row]);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef __TYPED_COLUMN_HPP__
+#define __TYPED_COLUMN_HPP__
+
+#include "cell_view.hpp"
+#include "row_bitmap.hpp"
+#include "zone_map.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Parsed values of a column declared as numeric, one packed slot per row,
+// kept beside the cell text (which is still what gets printed).  INT64 and
+// DATE (days since 1970-01-01, written YYYY-MM-DD) share the int64 array;
+// DOUBLE has its own.  Cells that do not parse as the declared type are
+// null: their slot holds 0 and their bit in present() is clear, so no
+// comparison selects them.  The smallest and largest value of every
+// Zone_Map::block_rows rows are kept too, so range scans can skip blocks;
+// like zone maps they only widen when a value is overwritten.
+class Typed_Column
+{
+public:
+    enum Type { TEXT, INT64, DOUBLE, DATE };
+
+private:
+    Type kind;
+    std::vector<int64_t> ints;
+    std::vector<double> reals;
+    Row_Bitmap valid;
+    std::vector<int64_t> int_min, int_max;
+    std::vector<double> real_min, real_max;
+
+public:
+    explicit Typed_Column(Type type) : kind(type) {}
+
+    Type type() const { return kind; }
+    int size() const { return valid.size(); }
+
+    // Add the value of the next row, or overwrite the value of an existing
+    // one.
+    void append(Cell_View cell);
+    void assign(int row, Cell_View cell);
+
+    const int64_t* int_data() const { return ints.data(); }
+    const double* real_data() const { return reals.data(); }
+    const Row_Bitmap& present() const { return valid; }
+
+    // Whether some value of the block may lie in [lo, hi].  False for a
+    // block of nulls followed by values.
+    bool may_overlap(int block, int64_t lo, int64_t hi) const
+    {
+        return block >= int_min.size() || (int_min[block] <= hi && int_max[block] >= lo);
+    }
+
+    bool may_overlap(int block, double lo, double hi) const
+    {
+        return block >= real_min.size() || (real_min[block] <= hi && real_max[block] >= lo);
+    }
+
+    // Parsers for the declared types; false if the whole text is not a value
+    // of the type.  Doubles are written in decimal, optionally with an
+    // exponent; values too large for a double are not accepted.
+    static bool parse_int(Cell_View text, int64_t& value);
+    static bool parse_double(Cell_View text, double& value);
+    static bool parse_date(Cell_View text, int64_t& value);
+};
+
+#endif //__TYPED_COLUMN_HPP__
@@ -0,0 +1,49 @@
+#include "zone_map.hpp"
+
+void Zone_Map::add(int row, Cell_View cell)
+{
+    int block = row / block_rows;
+    if(block >= zones.size())
+        zones.resize(block + 1);
+    Zone& zone = zones[block];
+
+    uint32_t length = cell.size();
+    if(length < zone.min_length)
+        zone.min_length = length;
+    if(length > zone.max_length)
+        zone.max_length = length;
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(cell.data());
+    for(std::size_t i = 0; i < cell.size(); i++)
+    {
+        zone.bytes[p[i] >> 6] |= uint64_t(1) << (p[i] & 63);
+        if(i + 1 < cell.size())
+        {
+            unsigned bit = pair_bit(p[i], p[i + 1]);
+            zone.pairs[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+}
+
+bool Zone_Map::may_contain(int block, const std::string& needle) const
+{
+    if(block < 0 || block >= zones.size())
+        return true;
+    const Zone& zone = zones[block];
+    if(needle.size() > zone.max_length)
+        return false;
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(needle.data());
+    for(std::size_t i = 0; i < needle.size(); i++)
+    {
+        if(!(zone.bytes[p[i] >> 6] >> (p[i] & 63) & 1))
+            return false;
+        if(i + 1 < needle.size())
+        {
+            unsigned bit = pair_bit(p[i], p[i + 1]);
+            if(!(zone.pairs[bit >> 6] >> (bit & 63) & 1))
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef __ZONE_MAP_HPP__
+#define __ZONE_MAP_HPP__
+
+#include "cell_view.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Summary of one text column, block_rows rows at a time: the shortest and
+// longest cell, the exact set of bytes that occur, and a 512-bit Bloom
+// filter of the adjacent byte pairs.  A block whose summary rules out a
+// needle cannot hold a match, so scans skip it without reading its cells.
+// Summaries only ever widen: overwriting a cell leaves the old value
+// counted, which costs a missed skip but never a missed row.
+class Zone_Map
+{
+public:
+    // A multiple of 64, so blocks start on Row_Bitmap word boundaries.
+    static const int block_rows = 4096;
+
+private:
+    struct Zone
+    {
+        uint32_t min_length = UINT32_MAX;
+        uint32_t max_length = 0;
+        uint64_t bytes[4] = {0, 0, 0, 0};
+        uint64_t pairs[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    };
+
+    std::vector<Zone> zones;
+
+    static unsigned pair_bit(unsigned char a, unsigned char b)
+    {
+        return ((uint32_t(a) << 8 | b) * 0x9E3779B1u) >> 23;
+    }
+
+public:
+    // Count a cell in the summary of its block.  Rows normally arrive in
+    // order; a row seen again after an overwrite widens its block.
+    void add(int row, Cell_View cell);
+
+    // False only if no cell of the block can contain needle.
+    bool may_contain(int block, const std::string& needle) const;
+
+    int blocks() const { return zones.size(); }
+    uint32_t min_length(int block) const { return zones[block].min_length; }
+    uint32_t max_length(int block) const { return zones[block].max_length; }
+};
+
+#endif //__ZONE_MAP_HPP__